@@ -3,69 +3,599 @@
 
 
 
-ARAP::ARAPSolver::ARAPSolver(Model* parsedModel, TriMesh& origMesh)
+ARAP::ARAPSolver::ARAPSolver(Model* parsedModel, const TriMesh& origMesh, int meshIndex, FillOrdering ordering, bool reportFactorizations)
 {
 	ModelDataPointer = parsedModel;
-	this->OrigMesh = origMesh;
-
-	edgeWeights = computeFanWeights(); //construct weights
-
+	MeshIndex = meshIndex;
+	this->reportFactorizations = reportFactorizations; //already needed for the candidates of Automatic below
+
+	//the rest state is kept in compact arrays only, origMesh is not needed after the precompute
+	restPos.resize(origMesh.n_vertices(), 3);
+	for (int i = 0; i < origMesh.n_vertices(); i++)
+		restPos.row(i) = vector3f_from_point(origMesh.point(OpenMesh::VertexHandle(i)));
+
+	edgeWeights = computeFanWeights(origMesh); //construct weights
+	std::vector<int> allVertices(restPos.rows());
+	std::iota(allVertices.begin(), allVertices.end(), 0);
+	rotationBatches = computeRotationBatches(allVertices);
+	computeComponents();
+	workspace.rotations.resize(restPos.rows(), Matrix3f::Identity());
+	workspace.pos.resize(restPos.rows(), 3);
+	workspace.b.resize(restPos.rows(), 3);
+
+	sysMatrix.ordering = ordering;
 	computeSystemMatrix(sysMatrix); //construct initial system Matrix
+	computeRhsOperator(sysMatrix);
 }
 
+ARAP::ARAPSolver::ARAPSolver(Model* parsedModel, int meshIndex, FillOrdering ordering, bool reportFactorizations)
+	: ARAPSolver(parsedModel, triMeshFromMesh(parsedModel->meshes[meshIndex]), meshIndex, ordering, reportFactorizations)
+{
+}
 
 ARAP::ARAPSolver::~ARAPSolver()
 {
 }
 
 
-void ARAP::ARAPSolver::ArapStep(int iterations)
+ARAP::ArapStepResult ARAP::ARAPSolver::ArapStep(int maxIterations, float tolerance, float budgetMs)
 {
+	ArapStepResult result;
 	if (constraints.size() == 0)
-		return;
+		return result;
 
-	if (changedConstraints)
+	if (lastConverged && !changedConstraintSet && !movedConstraints) { //idle and at rest: skip all work
+		result.energy = lastEnergy;
+		result.converged = true;
+		return result;
+	}
+	const auto start = std::chrono::steady_clock::now();
+
+	//the previous pose is a useful trend only if the same handles were moved in the meantime
+	const bool predict = temporalPrediction && predictionValid && movedConstraints && !changedConstraintSet;
+	const bool coarse = !hierarchy.empty() && !region.enabled() && (movedConstraints || changedConstraintSet); //idle frames only continue the fine iterations
+	const bool changedSet = changedConstraintSet;
+	const bool changedTargets = changedConstraintSet || movedConstraints; //the last pose does not satisfy the constraints
+	if (changedConstraintSet) {
+		updateComponents();
+		if (region.enabled())
+			updateRegion();
 		setSystemMatrixConstraints(constraints);
-	changedConstraints = false;
+		if (!hierarchy.empty())
+			setHierarchyConstraints();
+	}
+	if (changedConstraintSet || movedConstraints) {
+		setConstraintRhs(constraints);
+		lastEnergy = -1; //energy of the last pose is no reference for the new targets
+	}
+	changedConstraintSet = false;
+	movedConstraints = false;
+
+	//view on the vertex positions of the model: one row per Vertex, strided over the interleaved vertex data
+	std::vector<Vertex>& vertices = ModelDataPointer->meshes[MeshIndex].vertices;
+	Map<Matrix<float, Dynamic, 3, RowMajor>, 0, OuterStride<>> modelPos(&vertices[0].Position.x, vertices.size(), 3, OuterStride<>(sizeof(Vertex) / sizeof(float)));
+
+	//init pos with vertex pos from last frame. An Anderson extrapolation the last call ran out of iterations for is checked first,
+	//the model got the plain step meanwhile
+	Matrix<float, Dynamic, 3>& pos = workspace.pos;
+	bool accelerated = andersonWindow > 0 && workspace.aaPending && !changedTargets; //pos is an Anderson extrapolation whose energy was not checked yet
+	if (!accelerated)
+		pos = modelPos;
+	if (coarse)
+		solveHierarchy();
+	const bool guessed = predict || coarse;
+	if (guessed) //pays for the first local step of the loop
+		result.energy = selectInitialGuess(pos, predict, coarse);
+	else if (changedTargets) //start from the handles at their targets, or the first local step measures the energy of the old pose
+		placeConstraintTargets(pos);
+	if (temporalPrediction) { //the last pose is the start of the trend for the next call, if it was solved for the current handles
+		workspace.prevPos = modelPos;
+		predictionValid = !changedSet;
+	}
 
-	vector_Matrix3f rotations;
-	vector_Vector3f pos;
+	//the local step evaluates the energy of the current pos for free. Compare it with the last iteration (or the last frame,
+	//if nothing moved since) and stop once the energy does not decrease anymore
+	float previousEnergy = lastEnergy;
+	if (andersonWindow > 0 && changedTargets) //the history belongs to the fixed point map of the current targets, calls in between (e.g. time slices) continue it
+		resetAnderson();
+	for (int ii = 0; ii < maxIterations; ii++) { //vertex iterations
+
+		//at least one iteration per call, further ones only if they are expected to fit into the budget
+		const float elapsedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (budgetMs > 0 && ii > 0 && elapsedMs + iterationMs > budgetMs)
+			break;
+		if (cancelFlag && ii > 0 && cancelFlag->load(std::memory_order_relaxed)) //preempted, the caller has newer input
+			break;
+		const auto iterationStart = std::chrono::steady_clock::now();
+
+		if (ii > 0 || !guessed)
+			result.energy = solveRotations(workspace.rotations, pos);
+		if (accelerated && result.energy > previousEnergy) {
+			//safeguard: the extrapolation raised the energy, fall back to the plain step and restart the history
+			pos = workspace.aaPlain;
+			resetAnderson();
+			result.energy = solveRotations(workspace.rotations, pos);
+		}
+		accelerated = false;
 
-	//init pos with vertex pos from last frame 
-	for (int i = 0; i < ModelDataPointer->meshes[0].vertices.size();i++) { //TODO better init with strides!
-		glm::vec3 gvp = ModelDataPointer->meshes[0].vertices[i].Position;
-		Vector3f vp(gvp.x, gvp.y, gvp.z);
-		pos.push_back(vp);
-	}
+		//the first iteration after a change only starts the descent from the new targets, judge convergence from the second one on
+		if (previousEnergy >= 0 && (ii > 1 || !changedTargets) && previousEnergy - result.energy <= tolerance * previousEnergy) {
+			result.converged = true;
+			break;
+		}
+
+		if (andersonWindow > 0)
+			workspace.aaPos = pos;
+		solvePositions(constraints, workspace.rotations, pos);
+		if (andersonWindow > 0)
+			accelerated = andersonStep(pos);
 
-	for (int ii = 0; ii < iterations; ii++) { //vertex iterations
+		previousEnergy = result.energy;
+		result.iterations++;
 
-		solveRotations(OrigMesh, rotations, pos);
-		solvePositions(constraints, rotations, pos);
+		const float lastIterationMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - iterationStart).count();
+		iterationMs = iterationMs > 0 ? 0.8f * iterationMs + 0.2f * lastIterationMs : lastIterationMs;
 	}
+	lastEnergy = result.energy;
+	lastConverged = result.converged;
+	if (andersonWindow > 0)
+		workspace.aaPending = accelerated;
 	
-	//update pos of vertices in ModelPointer
-	for (int i = 0;i < pos.size();i++) { //TODO find faster solution
-		Vector3f curPos = pos.at(i);
-		ModelDataPointer->meshes[0].vertices[i].Position = glm::vec3(curPos.x(), curPos.y(), curPos.z());
+	//update pos of vertices in ModelPointer. The last extrapolation was never checked, return the plain step and keep it for the next call
+	if (result.iterations > 0)
+		modelPos = accelerated ? workspace.aaPlain : pos; //uploaded by the caller, GL calls belong to the thread of the context
+
+	return result;
+}
+
+void ARAP::ARAPSolver::setCancelFlag(const std::atomic<bool>* flag)
+{
+	cancelFlag = flag;
+}
+
+void ARAP::ARAPSolver::setTemporalPrediction(bool enable)
+{
+	temporalPrediction = enable;
+	predictionValid = false;
+
+	const Index n = enable ? restPos.rows() : 0;
+	workspace.prevPos.resize(n, 3);
+	workspace.predPos.resize(n, 3);
+	workspace.predRotations.resize(enable || !hierarchy.empty() ? restPos.rows() : 0);
+}
+
+float ARAP::ARAPSolver::selectInitialGuess(Matrix<float, Dynamic, 3>& pos, bool extrapolate, bool coarse)
+{
+	//both candidates are built from the last pose, before pos is touched
+	if (extrapolate)
+		workspace.predPos = 2 * pos - workspace.prevPos; //constant velocity: pos is the last pose, prevPos the one before
+	if (coarse)
+		prolongate(*hierarchy[0], edgeWeights, pos, workspace.coarsePos);
+
+	//all guesses start at the new handle targets, the free vertices are what the candidates are about
+	placeConstraintTargets(pos);
+	if (extrapolate)
+		placeConstraintTargets(workspace.predPos);
+	if (coarse)
+		placeConstraintTargets(workspace.coarsePos);
+
+	float energy = solveRotations(workspace.rotations, pos);
+	auto consider = [&](Matrix<float, Dynamic, 3>& guess) {
+		std::copy(workspace.rotations.begin(), workspace.rotations.end(), workspace.predRotations.begin());
+		const float guessEnergy = solveRotations(workspace.predRotations, guess);
+		if (guessEnergy >= energy) //safeguard: the guess overshoots, e.g. the drag stopped or turned
+			return;
+		pos.swap(guess);
+		workspace.rotations.swap(workspace.predRotations);
+		energy = guessEnergy;
+	};
+	if (extrapolate)
+		consider(workspace.predPos);
+	if (coarse)
+		consider(workspace.coarsePos);
+	return energy;
+}
+
+void ARAP::ARAPSolver::placeConstraintTargets(Matrix<float, Dynamic, 3>& pos) const
+{
+	for (int i = 0; i < constraints.size(); i++) {
+		if (sysMatrix.regional && sysMatrix.conColumns[i] < 0) //outside of the region of interest, stays where it is
+			continue;
+		pos.row(constraints[i].first) = constraints[i].second;
+	}
+}
+
+void ARAP::ARAPSolver::setRegionOfInterest(const std::vector<int>& vertices)
+{
+	region.selection = vertices;
+	region.rings = 0;
+	region.valid = false;
+	sysMatrix.regional = region.enabled();
+	changedConstraintSet = true;
+}
+
+void ARAP::ARAPSolver::setRegionOfInterestRings(int rings)
+{
+	region.selection.clear();
+	region.rings = std::max(0, rings);
+	region.valid = false;
+	sysMatrix.regional = region.enabled();
+	changedConstraintSet = true;
+}
+
+void ARAP::ARAPSolver::computeComponents()
+{
+	const int vertexCount = restPos.rows();
+	components.of.assign(vertexCount, -1);
+	components.count = 0;
+
+	//flood fill over the fans
+	std::vector<int> stack;
+	for (int seed = 0; seed < vertexCount; seed++) {
+		if (components.of[seed] >= 0)
+			continue;
+		components.of[seed] = components.count;
+		stack.push_back(seed);
+		while (!stack.empty()) {
+			const int v = stack.back();
+			stack.pop_back();
+			for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+				const int u = edgeWeights.neighbors[jj];
+				if (components.of[u] < 0) {
+					components.of[u] = components.count;
+					stack.push_back(u);
+				}
+			}
+		}
+		components.count++;
+	}
+	components.active.assign(components.count, 1);
+}
+
+void ARAP::ARAPSolver::updateComponents()
+{
+	std::vector<char> active(components.count, 0);
+	for (const auto& con : constraints)
+		active[components.of[con.first]] = 1;
+	if (active == components.active)
+		return;
+	components.active = std::move(active);
+
+	std::vector<int> activeVertices;
+	components.idleVertices.clear();
+	for (int v = 0; v < components.of.size(); v++) {
+		if (components.active[components.of[v]])
+			activeVertices.push_back(v);
+		else
+			components.idleVertices.push_back(v);
+	}
+	components.batches = components.idleVertices.empty() ? RotationBatches() : computeRotationBatches(activeVertices);
+}
+
+void ARAP::ARAPSolver::updateRegion()
+{
+	const int vertexCount = restPos.rows();
+	std::vector<int> vertices;
+	if (region.rings > 0) {
+		//breadth first search over the fans, one ring per step
+		std::vector<char> visited(vertexCount, 0);
+		for (const auto& con : constraints) {
+			if (!visited[con.first])
+				vertices.push_back(con.first);
+			visited[con.first] = 1;
+		}
+		size_t begin = 0;
+		for (int r = 0; r < region.rings; r++) {
+			const size_t end = vertices.size();
+			for (size_t k = begin; k < end; k++) {
+				const int v = vertices[k];
+				for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+					const int u = edgeWeights.neighbors[jj];
+					if (!visited[u]) {
+						visited[u] = 1;
+						vertices.push_back(u);
+					}
+				}
+			}
+			begin = end;
+		}
+
+		//the current region still contains the rings around all constraints: keep it, its batches and ordering stay valid
+		if (region.valid && std::all_of(vertices.begin(), vertices.end(), [this](int v) { return region.inside[v]; }))
+			return;
+	}
+	else {
+		if (region.valid)
+			return;
+		vertices = region.selection;
+	}
+
+	region.inside.assign(vertexCount, 0);
+	for (int v : vertices)
+		region.inside[v] = 1;
+	region.ring.clear();
+	for (int v : vertices) {
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+			const int u = edgeWeights.neighbors[jj];
+			if (region.inside[u] == 0) {
+				region.inside[u] = 2; //marks the ring for the moment
+				region.ring.push_back(u);
+			}
+		}
+	}
+	for (int u : region.ring)
+		region.inside[u] = 0;
+
+	std::vector<int> active(vertices);
+	active.insert(active.end(), region.ring.begin(), region.ring.end());
+	region.batches = computeRotationBatches(active);
+	region.vertices = std::move(vertices);
+	region.valid = true;
+}
+
+void ARAP::ARAPSolver::setHierarchyLevels(int levels)
+{
+	hierarchy.clear();
+	while (hierarchy.size() < levels) {
+		const FanWeights& fans = hierarchy.empty() ? edgeWeights : hierarchy.back()->fans;
+		const Matrix<float, Dynamic, 3>& fineRestPos = hierarchy.empty() ? restPos : hierarchy.back()->restPos;
+		const std::vector<int>& fineComponent = hierarchy.empty() ? components.of : hierarchy.back()->component;
+		std::unique_ptr<HierarchyLevel> level = coarsenLevel(fans, fineRestPos, fineComponent);
+		if (level->restPos.rows() < hierarchyMinVertices)
+			break;
+		hierarchy.push_back(std::move(level));
 	}
-	ModelDataPointer->meshes[0].UpdateMeshVertices();
 
+	const Index n = hierarchy.empty() ? 0 : restPos.rows();
+	workspace.coarsePos.resize(n, 3);
+	workspace.predRotations.resize(temporalPrediction || !hierarchy.empty() ? restPos.rows() : 0);
+	changedConstraintSet = true; //the new levels need their constrained clusters
+}
+
+std::unique_ptr<ARAP::HierarchyLevel> ARAP::ARAPSolver::coarsenLevel(const FanWeights& fans, const Matrix<float, Dynamic, 3>& fineRestPos, const std::vector<int>& fineComponent)
+{
+	std::unique_ptr<HierarchyLevel> levelPtr(new HierarchyLevel());
+	HierarchyLevel& level = *levelPtr;
+	const int fineCount = fineRestPos.rows();
+
+	//greedy clustering in vertex order: every unclustered vertex starts a cluster with its unclustered neighbors, about a quarter of the vertices remain
+	level.parent.assign(fineCount, -1);
+	int clusterCount = 0;
+	for (int v = 0; v < fineCount; v++) {
+		if (level.parent[v] >= 0)
+			continue;
+		level.parent[v] = clusterCount;
+		for (size_t jj = fans.offsets[v]; jj < fans.offsets[v + 1]; jj++)
+			if (level.parent[fans.neighbors[jj]] < 0)
+				level.parent[fans.neighbors[jj]] = clusterCount;
+		clusterCount++;
+	}
+
+	std::vector<int> memberCount(clusterCount, 0);
+	level.restPos.setZero(clusterCount, 3);
+	for (int v = 0; v < fineCount; v++) {
+		level.restPos.row(level.parent[v]) += fineRestPos.row(v);
+		memberCount[level.parent[v]]++;
+	}
+	for (int c = 0; c < clusterCount; c++)
+		level.restPos.row(c) /= memberCount[c];
+
+	//two clusters are neighbors if any of their members are, the fine weights between them add up (and stay non-negative)
+	std::vector<Triplet<float>> triplets;
+	for (int v = 0; v < fineCount; v++)
+		for (size_t jj = fans.offsets[v]; jj < fans.offsets[v + 1]; jj++)
+			if (level.parent[v] != level.parent[fans.neighbors[jj]])
+				triplets.emplace_back(level.parent[v], level.parent[fans.neighbors[jj]], fans.weights[jj]);
+	SparseMatrix<float, RowMajor> W(clusterCount, clusterCount);
+	W.setFromTriplets(triplets.begin(), triplets.end());
+
+	FanWeights& graph = level.fans;
+	graph.offsets.assign(W.outerIndexPtr(), W.outerIndexPtr() + clusterCount + 1);
+	graph.neighbors.assign(W.innerIndexPtr(), W.innerIndexPtr() + W.nonZeros());
+	graph.weights.assign(W.valuePtr(), W.valuePtr() + W.nonZeros());
+	graph.restEdges.resize(W.nonZeros(), 3);
+	graph.restEnergy.assign(clusterCount, 0.f);
+	for (int c = 0; c < clusterCount; c++) {
+		for (size_t jj = graph.offsets[c]; jj < graph.offsets[c + 1]; jj++) {
+			const auto edge = level.restPos.row(graph.neighbors[jj]) - level.restPos.row(c);
+			graph.restEdges.row(jj) = graph.weights[jj] * edge;
+			graph.restEnergy[c] += graph.weights[jj] * edge.squaredNorm();
+		}
+	}
+
+	//fill-reducing ordering of the Laplacian of the clusters, constraint toggles only reuse it like on the mesh
+	triplets.clear();
+	for (int c = 0; c < clusterCount; c++) {
+		float diag = 0;
+		for (size_t jj = graph.offsets[c]; jj < graph.offsets[c + 1]; jj++) {
+			triplets.emplace_back(c, graph.neighbors[jj], -graph.weights[jj]);
+			diag += graph.weights[jj];
+		}
+		triplets.emplace_back(c, c, diag);
+	}
+	SparseMatrix<float> L(clusterCount, clusterCount);
+	L.setFromTriplets(triplets.begin(), triplets.end());
+	PermutationMatrix<Dynamic, Dynamic, int> Pinv;
+	AMDOrdering<int> ordering;
+	ordering(L, Pinv);
+	level.order.assign(Pinv.indices().data(), Pinv.indices().data() + clusterCount);
+
+	level.component.resize(clusterCount);
+	for (int v = 0; v < fineCount; v++)
+		level.component[level.parent[v]] = fineComponent[v];
+
+	level.pos = level.restPos;
+	level.prevPos = level.restPos;
+	level.rotations.resize(clusterCount, Matrix3f::Identity());
+	level.prevRotations.resize(clusterCount, Matrix3f::Identity());
+	return levelPtr;
+}
+
+void ARAP::ARAPSolver::setHierarchyConstraints()
+{
+	//cluster of every constrained vertex on the current level, starting with the mesh itself
+	std::vector<int> conCluster(constraints.size());
+	for (int i = 0; i < constraints.size(); i++)
+		conCluster[i] = constraints[i].first;
+
+	for (auto& levelPtr : hierarchy) {
+		HierarchyLevel& level = *levelPtr;
+		const int clusterCount = level.restPos.rows();
+		std::vector<int> conIdx(clusterCount, -1); //maps cluster to column in L_fc
+		level.conClusters.clear();
+		level.conMembers.clear();
+		level.conColumns.resize(constraints.size());
+		for (int i = 0; i < constraints.size(); i++) {
+			conCluster[i] = level.parent[conCluster[i]];
+			if (conIdx[conCluster[i]] < 0) {
+				conIdx[conCluster[i]] = level.conClusters.size();
+				level.conClusters.push_back(conCluster[i]);
+				level.conMembers.push_back(0);
+			}
+			level.conColumns[i] = conIdx[conCluster[i]];
+			level.conMembers[conIdx[conCluster[i]]]++;
+		}
+
+		level.freeIdx.assign(clusterCount, -1);
+		level.freeClusters.clear();
+		for (int c : level.order) {
+			if (conIdx[c] >= 0 || !components.active[level.component[c]])
+				continue;
+			level.freeIdx[c] = level.freeClusters.size();
+			level.freeClusters.push_back(c);
+		}
+		const int freeCount = level.freeClusters.size();
+
+		//the same split as in the reduced system of the mesh, straight from the graph of the clusters
+		std::vector<Triplet<float>> ff, fc;
+		for (int c = 0; c < clusterCount; c++) {
+			const int row = level.freeIdx[c];
+			if (row < 0)
+				continue;
+			float diag = 0;
+			for (size_t jj = level.fans.offsets[c]; jj < level.fans.offsets[c + 1]; jj++) {
+				const int u = level.fans.neighbors[jj];
+				diag += level.fans.weights[jj];
+				if (level.freeIdx[u] >= 0) {
+					if (level.freeIdx[u] > row) //lower triangle only
+						ff.emplace_back(level.freeIdx[u], row, -level.fans.weights[jj]);
+				}
+				else
+					fc.emplace_back(row, conIdx[u], -level.fans.weights[jj]);
+			}
+			ff.emplace_back(row, row, diag);
+		}
+		SparseMatrix<float> L_ff(freeCount, freeCount);
+		L_ff.setFromTriplets(ff.begin(), ff.end());
+		level.L_fc.resize(freeCount, level.conClusters.size());
+		level.L_fc.setFromTriplets(fc.begin(), fc.end());
+		level.solver.compute(L_ff);
+		level.factorNonZeros = level.solver.matrixL().nestedExpression().nonZeros();
+
+		level.b_f.resize(freeCount, 3);
+		level.x_f.resize(freeCount, 3);
+		level.x_c.resize(level.conClusters.size(), 3);
+	}
+}
+
+void ARAP::ARAPSolver::solveHierarchy()
+{
+	//the prolongation needs the change of every level over this call
+	for (auto& levelPtr : hierarchy) {
+		HierarchyLevel& level = *levelPtr;
+		level.prevPos = level.pos;
+		std::copy(level.rotations.begin(), level.rotations.end(), level.prevRotations.begin());
+	}
+
+	for (int k = hierarchy.size() - 1; k >= 0; k--) {
+		HierarchyLevel& level = *hierarchy[k];
+		const FanWeights& fans = level.fans;
+		const int clusterCount = level.restPos.rows();
+		if (k + 1 < hierarchy.size())
+			prolongate(*hierarchy[k + 1], level.fans, level.pos, level.pos);
+
+		//target of a constrained cluster: where its center has to be so that its constrained members are at their targets, averaged over them
+		level.x_c.setZero();
+		for (int i = 0; i < constraints.size(); i++) {
+			const int col = level.conColumns[i];
+			const int c = level.conClusters[col];
+			const Vector3f offset = level.rotations[c] * (restPos.row(constraints[i].first) - level.restPos.row(c)).transpose();
+			level.x_c.row(col) += (constraints[i].second - offset).transpose() / level.conMembers[col];
+		}
+		for (int col = 0; col < level.conClusters.size(); col++)
+			level.pos.row(level.conClusters[col]) = level.x_c.row(col);
+
+		//every level is solved to its own convergence: the finer level only starts from a good guess if the coarse one has spread
+		//the motion of the handles over the whole mesh, a fixed handful of iterations leaves most of it to the fine iterations
+		double previousEnergy = -1;
+		for (int ii = 0; ii < hierarchyMaxIterations; ii++) {
+			//local step, a plain SVD per cluster. Also sums the energy of the level like solveRotationBatch does for the mesh
+			double energy = 0;
+#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads()) reduction(+:energy)
+			for (int c = 0; c < clusterCount; c++) {
+				if (!components.active[level.component[c]])
+					continue;
+				Matrix3f covariance = Matrix3f::Zero();
+				float deformedEnergy = 0;
+				for (size_t jj = fans.offsets[c]; jj < fans.offsets[c + 1]; jj++) {
+					const RowVector3f edge = level.pos.row(fans.neighbors[jj]) - level.pos.row(c);
+					covariance += fans.restEdges.row(jj).transpose() * edge;
+					deformedEnergy += fans.weights[jj] * edge.squaredNorm();
+				}
+				level.rotations[c] = procrustes(covariance);
+				energy += fans.restEnergy[c] + deformedEnergy - 2 * (level.rotations[c] * covariance).trace();
+			}
+			if (previousEnergy >= 0 && previousEnergy - energy <= hierarchyTolerance * previousEnergy)
+				break;
+			previousEnergy = energy;
+
+			//global step on the free clusters
+#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+			for (int row = 0; row < level.freeClusters.size(); row++) {
+				const int c = level.freeClusters[row];
+				RowVector3f b = RowVector3f::Zero();
+				for (size_t jj = fans.offsets[c]; jj < fans.offsets[c + 1]; jj++)
+					b -= 0.5f * fans.restEdges.row(jj) * (level.rotations[c] + level.rotations[fans.neighbors[jj]]).transpose();
+				level.b_f.row(row) = b;
+			}
+			level.b_f.noalias() -= level.L_fc * level.x_c;
+			level.x_f = level.solver.solve(level.b_f);
+			for (int row = 0; row < level.freeClusters.size(); row++)
+				level.pos.row(level.freeClusters[row]) = level.x_f.row(row);
+		}
+	}
+}
+
+void ARAP::ARAPSolver::prolongate(const HierarchyLevel& coarse, const FanWeights& fineFans, const Matrix<float, Dynamic, 3>& finePos, Matrix<float, Dynamic, 3>& prolongated)
+{
+	//every vertex only reads its own position, the neighbors only contribute their cluster
+	const int fineCount = coarse.parent.size();
+#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+	for (int v = 0; v < fineCount; v++) {
+		auto moved = [&](int c) -> RowVector3f {
+			const Matrix3f R = coarse.rotations[c] * coarse.prevRotations[c].transpose();
+			return coarse.pos.row(c) + (finePos.row(v) - coarse.prevPos.row(c)) * R.transpose();
+		};
+		RowVector3f sum = moved(coarse.parent[v]);
+		for (size_t jj = fineFans.offsets[v]; jj < fineFans.offsets[v + 1]; jj++)
+			sum += moved(coarse.parent[fineFans.neighbors[jj]]);
+		prolongated.row(v) = sum / float(fineFans.offsets[v + 1] - fineFans.offsets[v] + 1);
+	}
 }
 
 void ARAP::ARAPSolver::toggleConstraint(int idx)
 {
-	glm::vec3 vertPos(ModelDataPointer->meshes[0].vertices[idx].Position);
+	glm::vec3 vertPos(ModelDataPointer->meshes[MeshIndex].vertices[idx].Position);
 	std::pair<int, Vector3f> constraint(idx, Vector3f(vertPos.x, vertPos.y, vertPos.z));
 	constraints.push_back(constraint);
 
-	changedConstraints = true;
+	changedConstraintSet = true;
 }
 
 void ARAP::ARAPSolver::untoggleConstraint(int i)
 {
 	constraints.erase(constraints.begin() + i);
-	changedConstraints = true;
+	changedConstraintSet = true;
 }
 
 void ARAP::ARAPSolver::UpdateConstraint(int idx, glm::vec3 pos)
@@ -74,44 +604,198 @@ void ARAP::ARAPSolver::UpdateConstraint(int idx, glm::vec3 pos)
 		if (constraints.at(i).first == idx)
 			constraints.at(i).second = Vector3f(pos.x, pos.y, pos.z);
 	}
-	changedConstraints = true;
+	movedConstraints = true; //only the rhs depends on the target pos, the system matrix stays valid
+}
+
+void ARAP::ARAPSolver::setReducedSystem(bool reduced)
+{
+	if (sysMatrix.reduced == reduced)
+		return;
+	sysMatrix.reduced = reduced;
+	sysMatrix.maskedPatternAnalyzed = false;
+	changedConstraintSet = true;
+}
+
+bool ARAP::ARAPSolver::setLinearSolver(LinearSolver type)
+{
+#ifndef ARAP_USE_CHOLMOD
+	if (type == LinearSolver::SupernodalLLT)
+		return false;
+#endif
+	if (sysMatrix.type == type)
+		return true;
+	sysMatrix.type = type;
+	sysMatrix.maskedPatternAnalyzed = false;
+	changedConstraintSet = true; //refactorize, or rebuild the preconditioner, with the new backend
+	return true;
+}
+
+void ARAP::ARAPSolver::setThreadCount(int threads)
+{
+	threadCount = threads;
+}
+
+int ARAP::ARAPSolver::activeThreads() const
+{
+#ifdef _OPENMP
+	return threadCount > 0 ? threadCount : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+void ARAP::ARAPSolver::setAndersonAcceleration(int window)
+{
+	andersonWindow = std::max(0, std::min(window, (int)andersonMaxWindow));
+
+	const Index n = restPos.rows();
+	const Index historySize = andersonWindow > 0 ? n : 0;
+	workspace.aaPos.resize(historySize, 3);
+	workspace.aaPlain.resize(historySize, 3);
+	workspace.aaPrevF.resize(historySize, 3);
+	workspace.aaPrevG.resize(historySize, 3);
+	workspace.aaDF.resize(3 * historySize, andersonWindow);
+	workspace.aaDG.resize(3 * historySize, andersonWindow);
+	resetAnderson();
+}
+
+void ARAP::ARAPSolver::setMemoryLean(bool lean)
+{
+	if (memoryLean == lean)
+		return;
+	memoryLean = lean;
+	if (lean) {
+		sysMatrix.K = SparseMatrix<float, RowMajor>();
+		sysMatrix.factorRows = SparseMatrix<float, RowMajor>();
+		sysMatrix.forwardLevels.clear();
+		sysMatrix.forwardRows.clear();
+		sysMatrix.backwardLevels.clear();
+		sysMatrix.backwardRows.clear();
+	}
+	else
+		computeRhsOperator(sysMatrix);
+	changedConstraintSet = true; //refactorize, with or without the level schedule
+}
+
+void ARAP::ARAPSolver::setFillOrdering(FillOrdering ordering)
+{
+	if (sysMatrix.ordering == ordering)
+		return;
+	sysMatrix.ordering = ordering;
+	computeSystemMatrix(sysMatrix); //new P, the fans are unchanged
+	sysMatrix.maskedPatternAnalyzed = false;
+	changedConstraintSet = true;
+}
+
+void ARAP::ARAPSolver::setFactorizationReport(bool enable)
+{
+	reportFactorizations = enable;
+}
+
+const ARAP::FactorizationStats& ARAP::ARAPSolver::factorizationStats() const
+{
+	return sysMatrix.stats;
+}
+
+size_t ARAP::ARAPSolver::memoryUsage() const
+{
+	auto vec = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+	auto dense = [](const auto& m) { return size_t(m.size()) * sizeof(float); };
+	auto sparse = [](const auto& m) { return size_t(m.nonZeros()) * (sizeof(float) + sizeof(int)) + size_t(m.outerSize() + 1) * sizeof(int); };
+	auto fans = [&](const FanWeights& f) { return vec(f.offsets) + vec(f.neighbors) + vec(f.weights) + dense(f.restEdges) + vec(f.restEnergy); };
+
+	//rest state
+	size_t bytes = dense(restPos) + fans(edgeWeights) + vec(rotationBatches.vertices);
+	bytes += vec(components.of) + vec(components.active) + vec(components.idleVertices) + vec(components.batches.vertices);
+	bytes += vec(region.selection) + vec(region.vertices) + vec(region.ring) + vec(region.inside) + vec(region.batches.vertices);
+
+	//system and factor
+	const size_t factorEntry = sizeof(float) + sizeof(int);
+	bytes += sparse(sysMatrix.L) + sparse(sysMatrix.L_fc) + sparse(sysMatrix.K) + sysMatrix.stats.nonZeros * factorEntry;
+	bytes += dense(sysMatrix.invDiag) + sparse(sysMatrix.factorRows) + dense(sysMatrix.factorD);
+	bytes += vec(sysMatrix.forwardLevels) + vec(sysMatrix.forwardRows) + vec(sysMatrix.backwardLevels) + vec(sysMatrix.backwardRows);
+	bytes += 2 * size_t(sysMatrix.P.size()) * sizeof(int);
+	bytes += vec(sysMatrix.freeIdx) + vec(sysMatrix.freeVertices) + vec(sysMatrix.fixedVertices) + vec(sysMatrix.conColumns);
+	bytes += vec(constraints) + dense(constraintRhs);
+
+	//workspace
+	const SolverWorkspace& w = workspace;
+	bytes += dense(w.pos) + vec(w.rotations) + dense(w.b) + dense(w.b_f) + dense(w.x_f) + dense(w.x_c);
+	bytes += dense(w.aaPos) + dense(w.aaPlain) + dense(w.aaPrevF) + dense(w.aaPrevG) + dense(w.aaDF) + dense(w.aaDG);
+	bytes += dense(w.cgR) + dense(w.cgZ) + dense(w.cgP) + dense(w.cgQ);
+	bytes += dense(w.prevPos) + dense(w.predPos) + dense(w.coarsePos) + vec(w.predRotations);
+
+	for (const auto& levelPtr : hierarchy) {
+		const HierarchyLevel& level = *levelPtr;
+		bytes += vec(level.parent) + fans(level.fans) + dense(level.restPos) + dense(level.pos) + dense(level.prevPos);
+		bytes += vec(level.rotations) + vec(level.prevRotations) + vec(level.component) + vec(level.order);
+		bytes += vec(level.freeIdx) + vec(level.freeClusters) + vec(level.conClusters) + vec(level.conColumns) + vec(level.conMembers);
+		bytes += sparse(level.L_fc) + level.factorNonZeros * factorEntry + dense(level.b_f) + dense(level.x_f) + dense(level.x_c);
+	}
+	return bytes;
+}
+
+TriMesh ARAP::ARAPSolver::triMeshFromMesh(const Mesh& mesh)
+{
+	TriMesh triMesh;
+	for (const Vertex& vertex : mesh.vertices)
+		triMesh.add_vertex(TriMesh::Point(vertex.Position.x, vertex.Position.y, vertex.Position.z));
+	for (int f = 0; f + 2 < mesh.indices.size(); f += 3)
+		triMesh.add_face(OpenMesh::VertexHandle(mesh.indices[f]), OpenMesh::VertexHandle(mesh.indices[f + 1]), OpenMesh::VertexHandle(mesh.indices[f + 2]));
+	return triMesh;
 }
 
 Vector3f ARAP::ARAPSolver::vector3f_from_point(const TriMesh::Point& p) {
-	changedConstraints = true;
 	return Vector3f(p[0], p[1], p[2]);
 }
 
 float ARAP::ARAPSolver::compute_weight(TriMesh::Point v, TriMesh::Point u, TriMesh::Point other) {
-	Vector3f vec1 = (vector3f_from_point(u) - vector3f_from_point(other)).normalized();
-	Vector3f vec2 = (vector3f_from_point(v) - vector3f_from_point(other)).normalized();
-	double angle = acos(vec1.dot(vec2));
-	return 1 / tan(angle);
+	//cot of the angle at other: dot over the norm of the cross product of the two edges, no acos and tan
+	const Vector3f vec1 = vector3f_from_point(u) - vector3f_from_point(other);
+	const Vector3f vec2 = vector3f_from_point(v) - vector3f_from_point(other);
+	const float sine = vec1.cross(vec2).norm();
+	if (sine <= 0) //degenerate triangle
+		return 0;
+	return vec1.dot(vec2) / sine;
 }
 
-ARAP::FanWeights ARAP::ARAPSolver::computeFanWeights()
+ARAP::FanWeights ARAP::ARAPSolver::computeFanWeights(const TriMesh& mesh)
 {
 	FanWeights all_weights;
-
-	for (auto v_it = OrigMesh.vertices_begin(); v_it != OrigMesh.vertices_end(); ++v_it) {
-		all_weights.offsets.push_back(all_weights.weights.size()); // mark offset for this vertex
-
-		for (TriMesh::VertexOHalfedgeIter voh_it = OrigMesh.cvoh_iter(*v_it); voh_it.is_valid(); ++voh_it) {
+	const int vertexCount = restPos.rows();
+
+	//offsets first, then every vertex fills its part of the fan arrays independently
+	all_weights.offsets.resize(vertexCount + 1);
+	all_weights.offsets[0] = 0;
+	for (int v = 0; v < vertexCount; v++)
+		all_weights.offsets[v + 1] = all_weights.offsets[v] + mesh.valence(OpenMesh::VertexHandle(v));
+	const size_t fanSize = all_weights.offsets[vertexCount];
+	all_weights.neighbors.resize(fanSize);
+	all_weights.weights.resize(fanSize);
+	all_weights.restEdges.resize(fanSize, 3);
+	all_weights.restEnergy.assign(vertexCount, 0.f);
+
+	#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+	for (int v = 0; v < vertexCount; v++) {
+		const TriMesh::VertexHandle vh(v);
+		size_t jj = all_weights.offsets[v];
+
+		for (TriMesh::VertexOHalfedgeIter voh_it = mesh.cvoh_iter(vh); voh_it.is_valid(); ++voh_it, ++jj) {
 			float weight = 0;
 			TriMesh::VertexHandle u = voh_it->to();
-			TriMesh::HalfedgeHandle oheh(OrigMesh.opposite_halfedge_handle(*voh_it));
+			TriMesh::HalfedgeHandle oheh(mesh.opposite_halfedge_handle(*voh_it));
 
-			if (!OrigMesh.is_boundary(*voh_it)) {
-				TriMesh::HalfedgeHandle nxt_heh = OrigMesh.next_halfedge_handle(*voh_it);
-				TriMesh::VertexHandle other = OrigMesh.to_vertex_handle(nxt_heh);
-				weight += compute_weight(OrigMesh.point(*v_it), OrigMesh.point(u), OrigMesh.point(other));
+			if (!mesh.is_boundary(*voh_it)) {
+				TriMesh::HalfedgeHandle nxt_heh = mesh.next_halfedge_handle(*voh_it);
+				TriMesh::VertexHandle other = mesh.to_vertex_handle(nxt_heh);
+				weight += compute_weight(mesh.point(vh), mesh.point(u), mesh.point(other));
 			}
-			if (!OrigMesh.is_boundary(oheh)) {
-				TriMesh::HalfedgeHandle prv_heh = OrigMesh.prev_halfedge_handle(oheh);
-				TriMesh::VertexHandle other = OrigMesh.from_vertex_handle(prv_heh);
-				weight += compute_weight(OrigMesh.point(*v_it), OrigMesh.point(u), OrigMesh.point(other));
+			if (!mesh.is_boundary(oheh)) {
+				TriMesh::HalfedgeHandle prv_heh = mesh.prev_halfedge_handle(oheh);
+				TriMesh::VertexHandle other = mesh.from_vertex_handle(prv_heh);
+				weight += compute_weight(mesh.point(vh), mesh.point(u), mesh.point(other));
 			}
-			if (!OrigMesh.is_boundary(*voh_it) && !OrigMesh.is_boundary(oheh)) {
+			if (!mesh.is_boundary(*voh_it) && !mesh.is_boundary(oheh)) {
 				weight /= 2;
 			}
 
@@ -119,146 +803,990 @@ ARAP::FanWeights ARAP::ARAPSolver::computeFanWeights()
 			if (weight < 0)
 				weight = 0;
 
-			
-			FanWeight fw{ u, weight };
-			all_weights.weights.push_back(fw);
-		}
+			all_weights.neighbors[jj] = u.idx();
+			all_weights.weights[jj] = weight;
 
+			const auto edge = restPos.row(u.idx()) - restPos.row(v);
+			all_weights.restEdges.row(jj) = weight * edge;
+			all_weights.restEnergy[v] += weight * edge.squaredNorm();
+		}
 	}
 
-	all_weights.offsets.push_back(all_weights.weights.size()); // end marker
-
 	return all_weights;
 }
 
-void ARAP::ARAPSolver::solveRotations(const TriMesh &mesh, vector_Matrix3f& solvedRotations, const vector_Vector3f& targetPos)
+void ARAP::ARAPSolver::sortFan(int v, std::vector<size_t>& fan) const
 {
-	solvedRotations.clear();
+	fan.resize(edgeWeights.offsets[v + 1] - edgeWeights.offsets[v]);
+	std::iota(fan.begin(), fan.end(), edgeWeights.offsets[v]);
+	std::sort(fan.begin(), fan.end(), [this](size_t a, size_t b) { return edgeWeights.neighbors[a] < edgeWeights.neighbors[b]; });
+}
 
-	// Iterate over each and every vertex v, v is the center point of the regarded mesh fan
-	for (auto v_it = mesh.vertices_begin(); v_it != mesh.vertices_end(); ++v_it) {
-		std::vector<float> localWeights;
+ARAP::RotationBatches ARAP::ARAPSolver::computeRotationBatches(const std::vector<int>& vertices)
+{
+	const int W = RotationBatches::width;
+
+	//counting sort of the vertices by valence
+	std::vector<std::vector<int>> byValence;
+	for (int v : vertices) {
+		const size_t valence = edgeWeights.offsets[v + 1] - edgeWeights.offsets[v];
+		if (valence >= byValence.size())
+			byValence.resize(valence + 1);
+		byValence[valence].push_back(v);
+	}
 
-		vector_Vector3f sourcePointsFan;
-		vector_Vector3f deformedPointsFan;
+	RotationBatches batches;
+	for (const auto& bucket : byValence) {
+		if (bucket.empty())
+			continue;
+		batches.vertices.insert(batches.vertices.end(), bucket.begin(), bucket.end());
+		batches.vertices.resize((batches.vertices.size() + W - 1) / W * W, -1); //pad last batch of this valence
+	}
 
-		//Better way to get from glm to eigen?
-		const Vector3f center = vector3f_from_point(mesh.point(*v_it));
-		glm::vec3 deformCenterVec = ModelDataPointer->meshes[0].vertices[v_it->idx()].Position;
-		const Vector3f center_deformed = Vector3f(deformCenterVec.x, deformCenterVec.y, deformCenterVec.z);
+	return batches;
+}
 
-		const size_t weight_idx_start = edgeWeights.offsets[v_it->idx()];
-		const size_t weight_idx_end = edgeWeights.offsets[v_it->idx() + 1];
+float ARAP::ARAPSolver::solveRotations(vector_Matrix3f& solvedRotations, const Matrix<float, Dynamic, 3>& targetPos)
+{
+	const int vertexCount = restPos.rows();
+	solvedRotations.resize(vertexCount, Matrix3f::Identity());
+
+	// Iterate over batches of vertices with the same valence, every vertex v is the center point of the regarded mesh fan.
+	// The fans are independent and every thread writes only the rotations of its own batch, so the result does not depend on the thread count.
+	// With a region of interest only its fans are visited, without one only the fans of components with constraints. The energy is the one of these fans
+	const RotationBatches& batches = region.enabled() ? region.batches : components.idleVertices.empty() ? rotationBatches : components.batches;
+	const int batchCount = batches.vertices.size() / RotationBatches::width;
+	double energy = 0;
+#pragma omp parallel for schedule(dynamic, rotationChunkSize / RotationBatches::width) num_threads(activeThreads()) reduction(+:energy)
+	for (int b = 0; b < batchCount; b++)
+		energy += solveRotationBatch(&batches.vertices[b * RotationBatches::width], solvedRotations, targetPos);
+
+	return energy;
+}
 
-		// loop through fan 
-		for (size_t ii = weight_idx_start; ii < weight_idx_end; ii++) {
-			//fan_weights.push_back(weights.weights[ii].weight); //TODO Weights
-			localWeights.push_back(edgeWeights.weights[ii].weight);
+float ARAP::ARAPSolver::solveRotationBatch(const int* batch, vector_Matrix3f& solvedRotations, const Matrix<float, Dynamic, 3>& targetPos)
+{
+	const int W = RotationBatches::width;
+	const size_t valence = edgeWeights.offsets[batch[0] + 1] - edgeWeights.offsets[batch[0]];
+
+	int lanes[W]; //vertex per lane, unused lanes repeat the first vertex and are not written back
+	for (int l = 0; l < W; l++)
+		lanes[l] = batch[l] >= 0 ? batch[l] : batch[0];
+
+	//accumulate A = Cov i^T = SUM(e'ij * (wij * eij)^T) lane wise from the precomputed weighted rest edges.
+	//The gather is scalar, the accumulation runs over all lanes at once
+	//Also accumulates SUM(wij * |e'ij|^2) for the energy SUM(wij * |e'ij - Ri * eij|^2) = rest + deformed - 2 * tr(Ri^T A)
+	alignas(32) float A[9][W] = {};
+	alignas(32) float deformedEnergy[W] = {};
+	alignas(32) float w[W], e[3][W], e_def[3][W];
+	for (size_t k = 0; k < valence; k++) {
+		for (int l = 0; l < W; l++) {
+			const int v = lanes[l];
+			const size_t jj = edgeWeights.offsets[v] + k;
+			const int u = edgeWeights.neighbors[jj];
+			w[l] = edgeWeights.weights[jj];
+			for (int c = 0; c < 3; c++) {
+				e[c][l] = edgeWeights.restEdges(jj, c);
+				e_def[c][l] = targetPos(u, c) - targetPos(v, c);
+			}
+		}
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				for (int l = 0; l < W; l++)
+					A[3 * r + c][l] += e_def[r][l] * e[c][l];
+		for (int l = 0; l < W; l++)
+			deformedEnergy[l] += w[l] * (e_def[0][l] * e_def[0][l] + e_def[1][l] * e_def[1][l] + e_def[2][l] * e_def[2][l]);
+	}
 
-			const OpenMesh::VertexHandle h= edgeWeights.weights[ii].vertex;
-			sourcePointsFan.push_back(vector3f_from_point(mesh.point(h)) - center);
+	//warm start from the rotations of the last local step
+	alignas(32) float qw[W], qx[W], qy[W], qz[W], angle[W];
+	for (int l = 0; l < W; l++) {
+		const Quaternionf q(solvedRotations[lanes[l]]);
+		qw[l] = q.w(); qx[l] = q.x(); qy[l] = q.y(); qz[l] = q.z();
+	}
 
-			deformedPointsFan.push_back(targetPos[h.idx()] - center_deformed);
+	//iterative rotation extraction (Mueller et al. 2016): rotate q by omega = SUM(r_c x a_c) / |SUM(r_c * a_c)| until R maximizes tr(R^T A),
+	//which is the rotation of the procrustes problem. Every lane does the same branch free operations
+	for (int iter = 0; iter < rotationMaxIterations; iter++) {
+		for (int l = 0; l < W; l++) {
+			const float R00 = 1 - 2 * (qy[l] * qy[l] + qz[l] * qz[l]), R01 = 2 * (qx[l] * qy[l] - qw[l] * qz[l]), R02 = 2 * (qx[l] * qz[l] + qw[l] * qy[l]);
+			const float R10 = 2 * (qx[l] * qy[l] + qw[l] * qz[l]), R11 = 1 - 2 * (qx[l] * qx[l] + qz[l] * qz[l]), R12 = 2 * (qy[l] * qz[l] - qw[l] * qx[l]);
+			const float R20 = 2 * (qx[l] * qz[l] - qw[l] * qy[l]), R21 = 2 * (qy[l] * qz[l] + qw[l] * qx[l]), R22 = 1 - 2 * (qx[l] * qx[l] + qy[l] * qy[l]);
+
+			float ox = 0, oy = 0, oz = 0, dot = 0;
+			const float Rc[3][3] = { { R00, R10, R20 }, { R01, R11, R21 }, { R02, R12, R22 } }; //columns of R
+			for (int c = 0; c < 3; c++) {
+				const float ax = A[c][l], ay = A[3 + c][l], az = A[6 + c][l]; //column c of A
+				ox += Rc[c][1] * az - Rc[c][2] * ay;
+				oy += Rc[c][2] * ax - Rc[c][0] * az;
+				oz += Rc[c][0] * ay - Rc[c][1] * ax;
+				dot += Rc[c][0] * ax + Rc[c][1] * ay + Rc[c][2] * az;
+			}
+			const float scale = 1.f / (std::abs(dot) + 1e-20f);
+			ox *= scale; oy *= scale; oz *= scale;
+
+			//q = AngleAxis(|omega|, omega / |omega|) * q
+			angle[l] = std::sqrt(ox * ox + oy * oy + oz * oz);
+			const bool rotate = angle[l] > rotationTolerance;
+			const float s = rotate ? std::sin(0.5f * angle[l]) / angle[l] : 0.f;
+			const float dw = rotate ? std::cos(0.5f * angle[l]) : 1.f;
+			const float dx = s * ox, dy = s * oy, dz = s * oz;
+
+			const float nw = dw * qw[l] - dx * qx[l] - dy * qy[l] - dz * qz[l];
+			const float nx = dw * qx[l] + dx * qw[l] + dy * qz[l] - dz * qy[l];
+			const float ny = dw * qy[l] - dx * qz[l] + dy * qw[l] + dz * qx[l];
+			const float nz = dw * qz[l] + dx * qy[l] - dy * qx[l] + dz * qw[l];
+			const float invNorm = 1.f / std::sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+			qw[l] = nw * invNorm; qx[l] = nx * invNorm; qy[l] = ny * invNorm; qz[l] = nz * invNorm;
 		}
 
-		Matrix3f rotation = procrustes(sourcePointsFan, deformedPointsFan, localWeights);
-		solvedRotations.push_back(rotation);
+		int active = 0;
+		for (int l = 0; l < W; l++)
+			active += angle[l] > rotationTolerance;
+		if (active == 0)
+			break;
 	}
+
+	float energy = 0;
+	for (int l = 0; l < W; l++) {
+		if (batch[l] < 0)
+			continue;
+		Matrix3f laneA;
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				laneA(r, c) = A[3 * r + c][l];
+		const Matrix3f extracted = Quaternionf(qw[l], qx[l], qy[l], qz[l]).toRotationMatrix();
+		if (angle[l] <= rotationTolerance && isTraceMaximum(extracted, laneA))
+			solvedRotations[batch[l]] = extracted;
+		else //not converged or stuck at a saddle, e.g. the identity warm start under a half turn: solve this lane with the SVD
+			solvedRotations[batch[l]] = procrustes(laneA.transpose());
+
+		const Matrix3f& R = solvedRotations[batch[l]];
+		float trace = 0;
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				trace += R(r, c) * A[3 * r + c][l];
+		energy += edgeWeights.restEnergy[batch[l]] + deformedEnergy[l] - 2 * trace;
+	}
+
+	return energy;
+}
+
+//omega vanishes wherever R^T A is symmetric, the maximum of tr(R^T A) is the one of these points where no small rotation
+//R * exp([w]x) increases the trace: w^T (tr(M) * I - M) w >= 0 for all w, M = R^T A. Checked with the leading minors, with some slack
+bool ARAP::ARAPSolver::isTraceMaximum(const Eigen::Matrix3f& R, const Eigen::Matrix3f& A)
+{
+	const Matrix3f M = R.transpose() * A;
+	const Matrix3f symmetric = 0.5f * (M + M.transpose());
+	const float slack = 1e-4f * symmetric.norm() + 1e-20f;
+	const Matrix3f B = (symmetric.trace() + slack) * Matrix3f::Identity() - symmetric;
+	return B(0, 0) > 0 && B(0, 0) * B(1, 1) - B(0, 1) * B(1, 0) > 0 && B.determinant() > 0;
 }
 
 //solves for rigid rotations with procrustes algotithm
-Eigen::Matrix3f ARAP::ARAPSolver::procrustes(const vector_Vector3f& sourcePoints, const vector_Vector3f& targetPoints, const std::vector<float>& weights)
+Eigen::Matrix3f ARAP::ARAPSolver::procrustes(const Eigen::Matrix3f& covariance)
 {
-	//setup
-	Matrix<float, Dynamic, 3> Source(sourcePoints.size(), 3);
-	Matrix<float, Dynamic, 3> Target(targetPoints.size(), 3);
-	Map<const VectorXf> diag(weights.data(), weights.size());
+	JacobiSVD<Matrix3f> svd(covariance, ComputeFullU | ComputeFullV); //fixed size SVD, no heap allocation
+	Matrix3f rotation = svd.matrixV() * svd.matrixU().transpose();
 
-	for (int i = 0; i < sourcePoints.size(); i++) {
-		Source.row(i) = sourcePoints[i];
-	}
-	for (int i = 0; i < targetPoints.size(); i++) {
-		Target.row(i) = targetPoints[i];
+	//reflection instead of rotation: flip the axis of the smallest singular value
+	if (rotation.determinant() < 0) {
+		Matrix3f U = svd.matrixU();
+		U.col(2) *= -1;
+		rotation = svd.matrixV() * U.transpose();
 	}
 
-	JacobiSVD<MatrixXf> svd(Source.transpose() * diag.asDiagonal() * Target, ComputeFullU | ComputeFullV);//Compute SVD to calculate Cov i = SUM(wij * eij * e'ij)
-	Matrix3f rotation = svd.matrixV() * svd.matrixU().transpose();
-
 	return rotation;
 }
 
 void ARAP::ARAPSolver::computeSystemMatrix(ARAP::SystemMatrix& mat)
 {
-	SystemMatrix ret{};
-
-	const size_t vertexCount = OrigMesh.n_vertices();
+	const int vertexCount = restPos.rows();
 
+	//the pattern is given by the fans: column v holds the diagonal and one entry per neighbor. L is symmetric, the solvers
+	//only read the lower triangle and the ordering symmetrizes the pattern itself, so only the neighbors after v are stored
 	SparseMatrix<float> L(vertexCount, vertexCount);
-	L.setZero();
+	for (int v = 0; v < vertexCount; v++) {
+		int count = 1;
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++)
+			count += edgeWeights.neighbors[jj] > v;
+		L.outerIndexPtr()[v + 1] = L.outerIndexPtr()[v] + count;
+	}
+	L.resizeNonZeros(L.outerIndexPtr()[vertexCount]);
+
+	//write the compressed matrix directly instead of inserting, every vertex fills its own column
+	#pragma omp parallel num_threads(activeThreads())
+	{
+		std::vector<size_t> fan; //fan of v sorted by neighbor
+		#pragma omp for schedule(dynamic, rotationChunkSize)
+		for (int v = 0; v < vertexCount; v++) {
+			sortFan(v, fan);
+			int* index = L.innerIndexPtr() + L.outerIndexPtr()[v];
+			float* value = L.valuePtr() + L.outerIndexPtr()[v];
+
+			float diagonal = 0;
+			for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++)
+				diagonal += edgeWeights.weights[jj];
+			*index++ = v;
+			*value++ = diagonal;
+			for (size_t jj : fan) {
+				if (edgeWeights.neighbors[jj] > v) {
+					*index++ = edgeWeights.neighbors[jj];
+					*value++ = -edgeWeights.weights[jj];
+				}
+			}
+		}
+	}
+
+	//the fill-reducing ordering is computed once here, constraint toggles only reuse it. The matrix itself is not kept,
+	//both the reduced and the masked system are assembled from the fans
+	mat.stats.ordering = mat.ordering;
+	if (mat.ordering != FillOrdering::Automatic)
+		computeFillOrdering(L, mat.ordering, mat.P);
+	else {
+		//try every ordering on the whole mesh and keep the cheapest factorization. Constraints only remove rows, free vertices keep
+		//their relative order, so the winner stays good for the reduced systems too. The file order of a mesh is rarely banded,
+		//the natural order is only a candidate if the loader reordered the vertices
+		const bool reordered = !ModelDataPointer->meshes[MeshIndex].originalIndex.empty();
+		double bestFlops = -1;
+		for (FillOrdering candidate : { FillOrdering::AMD, FillOrdering::COLAMD, FillOrdering::NestedDissection, FillOrdering::Natural }) {
+			if (candidate == FillOrdering::Natural && !reordered)
+				continue;
+			const auto start = std::chrono::steady_clock::now();
+			PermutationMatrix<Dynamic, Dynamic, int> P;
+			computeFillOrdering(L, candidate, P);
+			const float orderingMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			size_t nonZeros;
+			double flops;
+			const bool cheaper = factorCost(P, nonZeros, flops, bestFlops); //stops counting once it costs more than the best so far
+			if (reportFactorizations) {
+				if (cheaper)
+					std::cout << "ARAP ordering " << orderingName(candidate) << ": nnz(L) " << nonZeros << ", " << flops << " flops, computed in " << orderingMs << " ms" << std::endl;
+				else
+					std::cout << "ARAP ordering " << orderingName(candidate) << ": more than " << bestFlops << " flops, computed in " << orderingMs << " ms" << std::endl;
+			}
+			if (cheaper && (bestFlops < 0 || flops < bestFlops)) {
+				bestFlops = flops;
+				mat.stats.ordering = candidate;
+				mat.P = std::move(P);
+			}
+		}
+	}
+	mat.Pinv = mat.P.inverse();
+}
 
-	for (auto v_it = OrigMesh.vertices_begin(); v_it != OrigMesh.vertices_end(); ++v_it) {
-		const auto v_idx = v_it->idx();
+void ARAP::ARAPSolver::computeFillOrdering(const SparseMatrix<float>& L, FillOrdering ordering, PermutationMatrix<Dynamic, Dynamic, int>& P)
+{
+	const int vertexCount = L.rows();
+	switch (ordering) {
+	case FillOrdering::AMD: {
+		//symmetrizes the lower triangle itself, returns the inverse permutation
+		PermutationMatrix<Dynamic, Dynamic, int> Pinv;
+		AMDOrdering<int> amd;
+		amd(L, Pinv);
+		P = Pinv.inverse();
+		break;
+	}
+	case FillOrdering::COLAMD: {
+		//orders the columns of a general matrix, needs both triangles. Returns the permutation itself
+		SparseMatrix<float> full = L.selfadjointView<Lower>();
+		COLAMDOrdering<int> colamd;
+		colamd(full, P);
+		break;
+	}
+	case FillOrdering::NestedDissection: {
+		const std::vector<int> order = nestedDissection();
+		P.resize(vertexCount);
+		for (int k = 0; k < vertexCount; k++)
+			P.indices()[order[k]] = k;
+		break;
+	}
+	default:
+		P.setIdentity(vertexCount);
+		break;
+	}
+}
 
-		const size_t weight_idx_start = edgeWeights.offsets[v_it->idx()];
-		const size_t weight_idx_end = edgeWeights.offsets[v_it->idx() + 1];
+std::vector<int> ARAP::ARAPSolver::nestedDissection() const
+{
+	const int vertexCount = restPos.rows();
+
+	//order is split in place: every part is a range of it, and the vertices of a part carry its begin as label. A part is cut along
+	//one level of a breadth first search from a peripheral vertex, the vertices before and after that level become the next parts and the
+	//level itself, the separator, is moved behind them. Eliminated last, the separator keeps the fill of the two parts apart
+	std::vector<int> order(vertexCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::vector<int> part(vertexCount, 0);
+	std::vector<int> level(vertexCount);
+	std::vector<int> visited(vertexCount, -1); //stamp of the last search that reached the vertex
+	std::vector<char> sides(vertexCount); //0 and 1 for the two halves of a cut part, 2 for its separator
+	std::vector<int> queue, levelSize;
+	queue.reserve(vertexCount);
+	int stamp = 0;
+
+	//breadth first search within one part, the reached vertices end up in queue. Returns the number of levels
+	auto search = [&](int root, int label) {
+		stamp++;
+		queue.clear();
+		queue.push_back(root);
+		visited[root] = stamp;
+		level[root] = 0;
+		for (size_t head = 0; head < queue.size(); head++) {
+			const int v = queue[head];
+			for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+				const int u = edgeWeights.neighbors[jj];
+				if (part[u] == label && visited[u] != stamp) {
+					visited[u] = stamp;
+					level[u] = level[v] + 1;
+					queue.push_back(u);
+				}
+			}
+		}
+		return level[queue.back()] + 1;
+	};
+
+	std::vector<std::pair<int, int>> parts = { { 0, vertexCount } };
+	while (!parts.empty()) {
+		const int begin = parts.back().first;
+		const int end = parts.back().second;
+		parts.pop_back();
+		if (end - begin <= dissectionLeafSize)
+			continue;
+
+		//parts are not always connected. Split off the component of the first vertex, its order within the range does not matter
+		int levels = search(order[begin], begin);
+		if (queue.size() < size_t(end - begin)) {
+			const int split = begin + queue.size();
+			std::stable_partition(order.begin() + begin, order.begin() + end, [&](int v) { return visited[v] == stamp; });
+			for (int k = split; k < end; k++)
+				part[order[k]] = split;
+			parts.emplace_back(begin, split);
+			parts.emplace_back(split, end);
+			continue;
+		}
 
-		// loop through fan
-		for (size_t jj = weight_idx_start; jj < weight_idx_end; jj++) {
-			const float weight = edgeWeights.weights[jj].weight;
-			const auto u_handle = edgeWeights.weights[jj].vertex;
-			const auto u_idx = u_handle.idx();
+		//pseudo-peripheral root: restart from the last vertex reached while that deepens the level structure. Deep and narrow levels make small separators
+		int root = order[begin];
+		for (int restart = 0; restart < 4; restart++) {
+			const int candidate = queue.back();
+			const int deeper = search(candidate, begin);
+			if (deeper < levels) {
+				search(root, begin); //restore the levels of the old root
+				break;
+			}
+			root = candidate;
+			if (deeper == levels)
+				break;
+			levels = deeper;
+		}
+		if (levels < 3)
+			continue; //no level separates anything
+
+		//separator: the smallest level that leaves at least a third of the part on either side
+		levelSize.assign(levels, 0);
+		for (int v : queue)
+			levelSize[level[v]]++;
+		const int size = end - begin;
+		int separator = -1;
+		for (int l = 1, before = levelSize[0]; l + 1 < levels; before += levelSize[l], l++) {
+			if (3 * before < size || 3 * (size - before - levelSize[l]) < size)
+				continue;
+			if (separator < 0 || levelSize[l] < levelSize[separator])
+				separator = l;
+		}
+		if (separator < 0) { //lopsided level structure, cut at the median vertex instead
+			separator = level[queue[queue.size() / 2]];
+			separator = std::max(1, std::min(separator, levels - 2));
+		}
+
+		//only separator vertices with a neighbor in the next level are needed to split the part, the others join the first side
+		auto side = [&](int v) {
+			if (level[v] < separator)
+				return 0;
+			if (level[v] > separator)
+				return 1;
+			for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+				const int u = edgeWeights.neighbors[jj];
+				if (part[u] == begin && level[u] > separator)
+					return 2;
+			}
+			return 0;
+		};
+		for (int k = begin; k < end; k++)
+			sides[order[k]] = side(order[k]);
+		std::stable_sort(order.begin() + begin, order.begin() + end, [&](int a, int b) { return sides[a] < sides[b]; });
+		const int firstEnd = std::find_if(order.begin() + begin, order.begin() + end, [&](int v) { return sides[v] > 0; }) - order.begin();
+		const int secondEnd = std::find_if(order.begin() + firstEnd, order.begin() + end, [&](int v) { return sides[v] > 1; }) - order.begin();
+		for (int k = firstEnd; k < end; k++)
+			part[order[k]] = k < secondEnd ? firstEnd : -1;
+		parts.emplace_back(begin, firstEnd);
+		parts.emplace_back(firstEnd, secondEnd);
+	}
+	return order;
+}
 
-			L.coeffRef(v_idx, v_idx) += weight;
-			L.coeffRef(v_idx, u_idx) -= weight;
+bool ARAP::ARAPSolver::factorCost(const PermutationMatrix<Dynamic, Dynamic, int>& P, size_t& nonZeros, double& flops, double flopLimit) const
+{
+	const int vertexCount = restPos.rows();
+	const int* perm = P.indices().data();
+	std::vector<int> Pinv(vertexCount);
+	for (int v = 0; v < vertexCount; v++)
+		Pinv[perm[v]] = v;
+
+	//column counts of the factor from the elimination tree, as in the symbolic analysis of the simplicial solvers: row k of L holds
+	//the columns on the tree paths from the entries of row k of P * L * P^T up to k.
+	//The sums are kept up to date while counting (c^2 grows by 2c + 1), they only grow, so an expensive ordering is dropped early
+	std::vector<int> parent(vertexCount), tags(vertexCount), count(vertexCount);
+	nonZeros = 0;
+	flops = 0;
+	for (int k = 0; k < vertexCount; k++) {
+		const int v = Pinv[k];
+		parent[k] = -1;
+		tags[k] = k;
+		count[k] = 1; //diagonal
+		nonZeros++;
+		flops++;
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+			for (int i = perm[edgeWeights.neighbors[jj]]; i < k && tags[i] != k; i = parent[i]) {
+				if (parent[i] < 0)
+					parent[i] = k;
+				flops += 2.0 * count[i] + 1;
+				count[i]++;
+				nonZeros++;
+				tags[i] = k;
+			}
 		}
+		if (flopLimit >= 0 && flops > flopLimit)
+			return false;
 	}
-	L.makeCompressed();
+	return true;
+}
 
-	mat.L_orig = L;
+void ARAP::ARAPSolver::computeRhsOperator(ARAP::SystemMatrix& mat)
+{
+	const int vertexCount = restPos.rows();
+
+	//b_v = SUM(0.5 * w_vu * (R_v + R_u) * (p_v - p_u)), every term is linear in the entries of R_v^T and R_u^T.
+	//Row v has three columns for v and for each neighbor, written in place like the Laplacian
+	mat.K.resize(vertexCount, 3 * vertexCount);
+	mat.K.resizeNonZeros(3 * (edgeWeights.weights.size() + vertexCount));
+	for (int v = 0; v <= vertexCount; v++)
+		mat.K.outerIndexPtr()[v] = 3 * (edgeWeights.offsets[v] + v);
+
+	#pragma omp parallel num_threads(activeThreads())
+	{
+		std::vector<size_t> fan; //fan of v sorted by neighbor
+		#pragma omp for schedule(dynamic, rotationChunkSize)
+		for (int v = 0; v < vertexCount; v++) {
+			sortFan(v, fan);
+			int* index = mat.K.innerIndexPtr() + mat.K.outerIndexPtr()[v];
+			float* value = mat.K.valuePtr() + mat.K.outerIndexPtr()[v];
+
+			// the weighted rest edges point from v to u
+			Vector3f diagonal = Vector3f::Zero();
+			for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++)
+				diagonal += -0.5f * edgeWeights.restEdges.row(jj).transpose();
+
+			bool placed = false;
+			for (size_t jj : fan) {
+				const int u_idx = edgeWeights.neighbors[jj];
+				if (!placed && u_idx > v) {
+					for (int c = 0; c < 3; c++) {
+						*index++ = 3 * v + c;
+						*value++ = diagonal[c];
+					}
+					placed = true;
+				}
+				for (int c = 0; c < 3; c++) {
+					*index++ = 3 * u_idx + c;
+					*value++ = -0.5f * edgeWeights.restEdges(jj, c);
+				}
+			}
+			for (int c = 0; !placed && c < 3; c++) {
+				*index++ = 3 * v + c;
+				*value++ = diagonal[c];
+			}
+		}
+	}
+}
+
+RowVector3f ARAP::ARAPSolver::rhsRow(int v, const vector_Matrix3f& rotations) const
+{
+	//b_v = SUM(-0.5 * (R_v + R_u) * w_vu * (p_u - p_v)), the weighted rest edges are stored anyway
+	Vector3f b_v = Vector3f::Zero();
+	for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++)
+		b_v -= 0.5f * (rotations[v] + rotations[edgeWeights.neighbors[jj]]) * edgeWeights.restEdges.row(jj).transpose();
+	return b_v.transpose();
 }
 
 void ARAP::ARAPSolver::setSystemMatrixConstraints(const std::vector<std::pair<int, Vector3f>>& constraints)
 {
-	sysMatrix.L = sysMatrix.L_orig;
-	auto& L = sysMatrix.L;
-	for (const auto& con : constraints) {
-		const auto idx = con.first;
-		for (int i = 0; i < L.cols(); i++)
-			L.coeffRef(idx, i) = 0;
-		for (int i = 0; i < L.rows(); i++)
-			L.coeffRef(i, idx) = 0;
-		L.coeffRef(idx, idx) = 1;
+	const int vertexCount = restPos.rows();
+
+	if (!sysMatrix.isReduced()) {
+		std::vector<int> conIdx(vertexCount, -1); //maps vertex index to constraint, vertices of idle components keep their position like constraints
+		for (int v : components.idleVertices)
+			conIdx[v] = constraints.size();
+		for (int i = 0; i < constraints.size(); i++)
+			conIdx[constraints[i].first] = i;
+
+		assembleMaskedSystemMatrix(conIdx);
+
+		//numeric refactorization only, the symbolic analysis of the pattern is reused
+		if (!sysMatrix.maskedPatternAnalyzed) {
+			analyzeSystemMatrix(sysMatrix.L);
+			sysMatrix.maskedPatternAnalyzed = true;
+		}
+		else
+			sysMatrix.stats.analyzeMs = 0;
+		factorizeSystemMatrix(sysMatrix.L);
+		return;
+	}
+
+	//split vertices into a free and a fixed block. Fixed are the constraints and the ring around the region of interest, outside of the region
+	//and in components without constraints everything else drops out. L_ff is block diagonal over the components, so their substitutions
+	//end up in the same levels and run concurrently. Free vertices keep their relative position in the cached ordering, so L_ff is already fill-reducing ordered
+	//and only the cheap elimination tree has to be rebuilt
+	sysMatrix.maskedPatternAnalyzed = false;
+	std::vector<int> fixedIdx(vertexCount, -1); //maps vertex index to column in L_fc
+	sysMatrix.fixedVertices.clear();
+	sysMatrix.conColumns.assign(constraints.size(), -1);
+	for (int i = 0; i < constraints.size(); i++) {
+		const int v = constraints[i].first;
+		if (sysMatrix.regional && !region.inside[v])
+			continue;
+		if (fixedIdx[v] < 0) {
+			fixedIdx[v] = sysMatrix.fixedVertices.size();
+			sysMatrix.fixedVertices.push_back(v);
+		}
+		sysMatrix.conColumns[i] = fixedIdx[v];
+	}
+	if (sysMatrix.regional) {
+		for (int v : region.ring) {
+			if (fixedIdx[v] < 0) {
+				fixedIdx[v] = sysMatrix.fixedVertices.size();
+				sysMatrix.fixedVertices.push_back(v);
+			}
+		}
 	}
-	sysMatrix.solver.compute(L);
+
+	sysMatrix.freeIdx.assign(vertexCount, -1);
+	sysMatrix.freeVertices.clear();
+	if (sysMatrix.regional) {
+		for (int v : region.vertices)
+			if (fixedIdx[v] < 0 && components.active[components.of[v]])
+				sysMatrix.freeVertices.push_back(v);
+		std::sort(sysMatrix.freeVertices.begin(), sysMatrix.freeVertices.end(), [this](int a, int b) { return sysMatrix.P.indices()[a] < sysMatrix.P.indices()[b]; });
+	}
+	else {
+		for (int k = 0; k < vertexCount; k++) {
+			const int v = sysMatrix.Pinv.indices()[k];
+			if (fixedIdx[v] < 0 && components.active[components.of[v]])
+				sysMatrix.freeVertices.push_back(v);
+		}
+	}
+	const int freeCount = sysMatrix.freeVertices.size();
+	for (int i = 0; i < freeCount; i++)
+		sysMatrix.freeIdx[sysMatrix.freeVertices[i]] = i;
+	const bool matrixFree = sysMatrix.type == LinearSolver::ConjugateGradient;
+
+	//row i of L is the fan of its vertex: the summed weights on the diagonal, -w for every neighbor. Every entry goes to L_ff or L_fc,
+	//so the work scales with the free block. The conjugate gradient never assembles L_ff and only keeps the diagonal
+	std::vector<Triplet<float>> ff, fc;
+	if (matrixFree)
+		sysMatrix.invDiag.resize(freeCount);
+	for (int i = 0; i < freeCount; i++) {
+		const int v = sysMatrix.freeVertices[i];
+		float diag = 0;
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+			const float weight = edgeWeights.weights[jj];
+			const int u = edgeWeights.neighbors[jj];
+			diag += weight;
+			if (sysMatrix.freeIdx[u] >= 0) {
+				if (!matrixFree && sysMatrix.freeIdx[u] > i) //lower triangle only, column i
+					ff.emplace_back(sysMatrix.freeIdx[u], i, -weight);
+			}
+			else
+				fc.emplace_back(i, fixedIdx[u], -weight);
+		}
+		if (matrixFree)
+			sysMatrix.invDiag[i] = 1.f / diag;
+		else
+			ff.emplace_back(i, i, diag);
+	}
+
+	sysMatrix.L_fc.resize(freeCount, sysMatrix.fixedVertices.size());
+	sysMatrix.L_fc.setFromTriplets(fc.begin(), fc.end());
+
+	if (matrixFree) {
+		sysMatrix.L = SparseMatrix<float>(); //release the free block of a previous direct backend
+		sysMatrix.stats.rows = 0; //nothing is factorized, the ordering still sorts the free vertices
+		sysMatrix.stats.nonZeros = 0;
+		sysMatrix.stats.flops = 0;
+		return;
+	}
+
+	sysMatrix.L.resize(freeCount, freeCount);
+	sysMatrix.L.setFromTriplets(ff.begin(), ff.end());
+	analyzeSystemMatrix(sysMatrix.L);
+	factorizeSystemMatrix(sysMatrix.L);
+}
+
+void ARAP::ARAPSolver::assembleMaskedSystemMatrix(const std::vector<int>& conIdx)
+{
+	const int vertexCount = restPos.rows();
+	const int* P = sysMatrix.P.indices().data();
+	const int* Pinv = sysMatrix.Pinv.indices().data();
+
+	//lower triangle of P * L * P^T straight from the fans: column k belongs to vertex Pinv[k], it holds the diagonal and the neighbors
+	//that come later in the ordering. Rows and columns of constraints are zeroed, but kept in the pattern so the symbolic analysis stays valid
+	SparseMatrix<float>& L = sysMatrix.L;
+	L.resize(vertexCount, vertexCount);
+	for (int k = 0; k < vertexCount; k++) {
+		const int v = Pinv[k];
+		int count = 1;
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++)
+			count += P[edgeWeights.neighbors[jj]] > k;
+		L.outerIndexPtr()[k + 1] = L.outerIndexPtr()[k] + count;
+	}
+	L.resizeNonZeros(L.outerIndexPtr()[vertexCount]);
+
+	#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+	for (int k = 0; k < vertexCount; k++) {
+		const int v = Pinv[k];
+		int* index = L.innerIndexPtr() + L.outerIndexPtr()[k];
+		float* value = L.valuePtr() + L.outerIndexPtr()[k];
+
+		float diagonal = 0;
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++)
+			diagonal += edgeWeights.weights[jj];
+		index[0] = k;
+		value[0] = conIdx[v] >= 0 ? 1.f : diagonal;
+
+		int count = 1;
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+			const int u = edgeWeights.neighbors[jj];
+			if (P[u] <= k)
+				continue;
+			//insertion sort by row, fans are short
+			int pos = count++;
+			for (; pos > 1 && index[pos - 1] > P[u]; pos--) {
+				index[pos] = index[pos - 1];
+				value[pos] = value[pos - 1];
+			}
+			index[pos] = P[u];
+			value[pos] = (conIdx[v] >= 0 || conIdx[u] >= 0) ? 0.f : -edgeWeights.weights[jj];
+		}
+	}
+}
+
+void ARAP::ARAPSolver::analyzeSystemMatrix(const SparseMatrix<float>& L)
+{
+	const auto start = std::chrono::steady_clock::now();
+	switch (sysMatrix.type) {
+	case LinearSolver::SimplicialLLT:
+		sysMatrix.solver.analyzePattern(L);
+		break;
+	case LinearSolver::SimplicialLDLT:
+		sysMatrix.ldlt.analyzePattern(L);
+		break;
+#ifdef ARAP_USE_CHOLMOD
+	case LinearSolver::SupernodalLLT:
+		sysMatrix.supernodal.analyzePattern(SparseMatrix<double>(L.cast<double>()));
+		break;
+#endif
+	default:
+		break;
+	}
+	sysMatrix.stats.analyzeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ARAP::ARAPSolver::factorizeSystemMatrix(const SparseMatrix<float>& L)
+{
+	FactorizationStats& stats = sysMatrix.stats;
+	const auto start = std::chrono::steady_clock::now();
+	switch (sysMatrix.type) {
+	case LinearSolver::SimplicialLLT:
+		sysMatrix.solver.factorize(L);
+		break;
+	case LinearSolver::SimplicialLDLT:
+		sysMatrix.ldlt.factorize(L);
+		break;
+#ifdef ARAP_USE_CHOLMOD
+	case LinearSolver::SupernodalLLT:
+		sysMatrix.supernodal.factorize(SparseMatrix<double>(L.cast<double>()));
+		break;
+#endif
+	default:
+		break;
+	}
+	stats.factorizeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stats.rows = L.rows();
+
+	if (sysMatrix.type == LinearSolver::SimplicialLLT || sysMatrix.type == LinearSolver::SimplicialLDLT) {
+		//the column counts of the factor give its fill and the flops it took. LDLT keeps its unit diagonal implicit and D apart,
+		//count D in its place like the diagonal of LLT
+		const SparseMatrix<float>& factor = factorMatrix();
+		const int diagonal = sysMatrix.type == LinearSolver::SimplicialLDLT ? 1 : 0;
+		stats.nonZeros = factor.nonZeros() + diagonal * factor.rows();
+		stats.flops = 0;
+		for (int k = 0; k < factor.outerSize(); k++) {
+			const double count = factor.outerIndexPtr()[k + 1] - factor.outerIndexPtr()[k] + diagonal;
+			stats.flops += count * count;
+		}
+		if (!memoryLean)
+			computeLevelSchedule();
+	}
+#ifdef ARAP_USE_CHOLMOD
+	else if (sysMatrix.type == LinearSolver::SupernodalLLT) {
+		//CHOLMOD counts both in its symbolic analysis, on top of its own ordering
+		stats.nonZeros = size_t(sysMatrix.supernodal.cholmod().lnz);
+		stats.flops = sysMatrix.supernodal.cholmod().fl;
+	}
+#endif
+	if (reportFactorizations)
+		reportFactorization();
 }
 
-void ARAP::ARAPSolver::solvePositions(const std::vector<std::pair<int, Vector3f>>& constraints, const vector_Matrix3f& rotations, vector_Vector3f& solvedPos)
+void ARAP::ARAPSolver::reportFactorization() const
 {
-	const size_t vertexCount = OrigMesh.n_vertices();
+	const FactorizationStats& stats = sysMatrix.stats;
+	std::cout << "ARAP factorization of " << stats.rows << " rows (" << orderingName(stats.ordering) << "): nnz(L) " << stats.nonZeros << ", " << stats.flops
+		<< " flops, analysis " << stats.analyzeMs << " ms, factorization " << stats.factorizeMs << " ms" << std::endl;
+}
 
-	Matrix<float, Dynamic, 3> b(vertexCount, 3);
-	b.setZero();
+const char* ARAP::ARAPSolver::orderingName(FillOrdering ordering)
+{
+	switch (ordering) {
+	case FillOrdering::AMD: return "AMD";
+	case FillOrdering::COLAMD: return "COLAMD";
+	case FillOrdering::NestedDissection: return "nested dissection";
+	case FillOrdering::Natural: return "natural";
+	default: return "automatic";
+	}
+}
 
-	//calc rhs b
-	for (auto v_it = OrigMesh.vertices_begin(); v_it != OrigMesh.vertices_end(); ++v_it) {
-		const auto v_idx = v_it->idx();
+void ARAP::ARAPSolver::solveSystemMatrix(const Matrix<float, Dynamic, 3>& b, Matrix<float, Dynamic, 3>& x)
+{
+#ifdef _OPENMP
+	//the substitutions dominate the global step once the local step runs in parallel. Level scheduling pays off only if enough of
+	//the factor falls into wide levels (Amdahl), narrow factors (small meshes, natural ordering) keep Eigen's serial solve
+	const int threads = activeThreads();
+	const float parallel = sysMatrix.levelParallelShare;
+	const bool levelScheduled = threads > 1 && !memoryLean && 1 / (1 - parallel + parallel / threads) >= levelScheduleMinSpeedup;
+#else
+	const bool levelScheduled = false;
+#endif
+
+	switch (sysMatrix.type) {
+	case LinearSolver::SimplicialLLT:
+		if (levelScheduled)
+			solveLevelScheduled(b, x);
+		else
+			x = sysMatrix.solver.solve(b);
+		break;
+	case LinearSolver::SimplicialLDLT:
+		if (levelScheduled)
+			solveLevelScheduled(b, x);
+		else
+			x = sysMatrix.ldlt.solve(b);
+		break;
+#ifdef ARAP_USE_CHOLMOD
+	case LinearSolver::SupernodalLLT: //CHOLMOD allocates its solution, no steady state without allocations here
+		x = sysMatrix.supernodal.solve(b.cast<double>()).cast<float>();
+		break;
+#endif
+	case LinearSolver::ConjugateGradient:
+		solveConjugateGradient(b, x);
+		break;
+	default:
+		break;
+	}
+}
 
-		const size_t weight_idx_start = edgeWeights.offsets[v_it->idx()];
-		const size_t weight_idx_end = edgeWeights.offsets[v_it->idx() + 1];
+const SparseMatrix<float>& ARAP::ARAPSolver::factorMatrix() const
+{
+	//both factors are computed with NaturalOrdering, so they factor the pre-ordered matrix itself without another permutation
+	if (sysMatrix.type == LinearSolver::SimplicialLDLT)
+		return sysMatrix.ldlt.matrixL().nestedExpression();
+	return sysMatrix.solver.matrixL().nestedExpression();
+}
 
-		// loop through fan
-		for (size_t jj = weight_idx_start; jj < weight_idx_end; jj++) {
-			const float weight = edgeWeights.weights[jj].weight;
-			const auto u_handle = edgeWeights.weights[jj].vertex;
-			const auto u_idx = u_handle.idx();
+void ARAP::ARAPSolver::computeLevelSchedule()
+{
+	const SparseMatrix<float>& L = factorMatrix();
+	const int n = L.cols();
+
+	//row i of L * y = b waits for all j < i with L(i, j) != 0, row j of L^T * x = y for all i > j with L(i, j) != 0.
+	//Columns of L are visited in the order their own level becomes final
+	std::vector<int> forward(n, 0), backward(n, 0);
+	for (int j = 0; j < n; j++)
+		for (SparseMatrix<float>::InnerIterator it(L, j); it; ++it)
+			if (it.row() > j)
+				forward[it.row()] = std::max(forward[it.row()], forward[j] + 1);
+	for (int j = n - 1; j >= 0; j--)
+		for (SparseMatrix<float>::InnerIterator it(L, j); it; ++it)
+			if (it.row() > j)
+				backward[j] = std::max(backward[j], backward[it.row()] + 1);
+
+	//counting sort of the rows by level
+	auto group = [n](const std::vector<int>& level, std::vector<int>& offsets, std::vector<int>& rows) {
+		const int levelCount = n > 0 ? *std::max_element(level.begin(), level.end()) + 1 : 0;
+		offsets.assign(levelCount + 1, 0);
+		for (int i = 0; i < n; i++)
+			offsets[level[i] + 1]++;
+		for (int k = 0; k < levelCount; k++)
+			offsets[k + 1] += offsets[k];
+		rows.resize(n);
+		std::vector<int> next(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < n; i++)
+			rows[next[level[i]]++] = i;
+	};
+	group(forward, sysMatrix.forwardLevels, sysMatrix.forwardRows);
+	group(backward, sysMatrix.backwardLevels, sysMatrix.backwardRows);
+
+	//the levels near the root of the elimination tree are narrow and stay serial, whatever the thread count
+	auto parallelShare = [n](const std::vector<int>& offsets) {
+		int parallelRows = 0;
+		for (int k = 0; k + 1 < offsets.size(); k++)
+			if (offsets[k + 1] - offsets[k] >= levelParallelRows)
+				parallelRows += offsets[k + 1] - offsets[k];
+		return n > 0 ? float(parallelRows) / n : 0.0f;
+	};
+	sysMatrix.levelParallelShare = std::min(parallelShare(sysMatrix.forwardLevels), parallelShare(sysMatrix.backwardLevels));
+
+	sysMatrix.factorRows = L;
+	if (sysMatrix.type == LinearSolver::SimplicialLDLT)
+		sysMatrix.factorD = sysMatrix.ldlt.vectorD();
+}
 
-			Matrix3f m_rot = rotations[v_idx] + rotations[u_idx];
-			Vector3f tmp = 0.5f * weight * m_rot * (vector3f_from_point(OrigMesh.point(*v_it)) - vector3f_from_point(OrigMesh.point(u_handle)));
-			b.row(v_idx) += tmp;
+void ARAP::ARAPSolver::solveLevelScheduled(const Matrix<float, Dynamic, 3>& b, Matrix<float, Dynamic, 3>& x)
+{
+	const SparseMatrix<float>& L = factorMatrix();
+	const SparseMatrix<float, RowMajor>& rows = sysMatrix.factorRows;
+	//LLT stores the diagonal in the factor, LDLT has a unit diagonal and D separately
+	const float* D = sysMatrix.type == LinearSolver::SimplicialLDLT ? sysMatrix.factorD.data() : nullptr;
+
+	//both substitutions work in place on x, all three coordinates of a row at once
+	x = b;
+
+	//L * y = b: y_i = (b_i - SUM(L_ij * y_j)) / L_ii
+	for (int k = 0; k + 1 < sysMatrix.forwardLevels.size(); k++) {
+		const int begin = sysMatrix.forwardLevels[k];
+		const int end = sysMatrix.forwardLevels[k + 1];
+#pragma omp parallel for schedule(static) num_threads(activeThreads()) if(end - begin >= levelParallelRows)
+		for (int r = begin; r < end; r++) {
+			const int i = sysMatrix.forwardRows[r];
+			RowVector3f sum = x.row(i);
+			float diag = 1;
+			for (SparseMatrix<float, RowMajor>::InnerIterator it(rows, i); it; ++it) {
+				if (it.col() == i)
+					diag = it.value();
+				else
+					sum -= it.value() * x.row(it.col());
+			}
+			x.row(i) = sum / diag;
 		}
 	}
 
-	//apply constraints to system
+	//L^T * x = D^-1 * y: x_i = (y_i / D_i - SUM(L_ji * x_j)) / L_ii, column i of L is row i of L^T
+	for (int k = 0; k + 1 < sysMatrix.backwardLevels.size(); k++) {
+		const int begin = sysMatrix.backwardLevels[k];
+		const int end = sysMatrix.backwardLevels[k + 1];
+#pragma omp parallel for schedule(static) num_threads(activeThreads()) if(end - begin >= levelParallelRows)
+		for (int r = begin; r < end; r++) {
+			const int i = sysMatrix.backwardRows[r];
+			RowVector3f sum = D ? RowVector3f(x.row(i) / D[i]) : RowVector3f(x.row(i));
+			float diag = 1;
+			for (SparseMatrix<float>::InnerIterator it(L, i); it; ++it) {
+				if (it.row() == i)
+					diag = it.value();
+				else
+					sum -= it.value() * x.row(it.row());
+			}
+			x.row(i) = sum / diag;
+		}
+	}
+}
+
+void ARAP::ARAPSolver::multiplyFreeLaplacian(const Matrix<float, Dynamic, 3>& x, Matrix<float, Dynamic, 3>& y)
+{
+	const int freeCount = sysMatrix.freeVertices.size();
+	y.resize(freeCount, 3);
+
+	//row i of L_ff is the fan of its vertex: the summed weights on the diagonal, -w for every free neighbor.
+	//Constrained neighbors belong to L_fc and are already on the rhs
+#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+	for (int i = 0; i < freeCount; i++) {
+		const int v = sysMatrix.freeVertices[i];
+		float diag = 0;
+		RowVector3f offDiag = RowVector3f::Zero();
+		for (size_t jj = edgeWeights.offsets[v]; jj < edgeWeights.offsets[v + 1]; jj++) {
+			const float weight = edgeWeights.weights[jj];
+			const int u = sysMatrix.freeIdx[edgeWeights.neighbors[jj]];
+			diag += weight;
+			if (u >= 0)
+				offDiag += weight * x.row(u);
+		}
+		y.row(i) = diag * x.row(i) - offDiag;
+	}
+}
+
+void ARAP::ARAPSolver::solveConjugateGradient(const Matrix<float, Dynamic, 3>& b, Matrix<float, Dynamic, 3>& x)
+{
+	Matrix<float, Dynamic, 3>& r = workspace.cgR;
+	Matrix<float, Dynamic, 3>& z = workspace.cgZ;
+	Matrix<float, Dynamic, 3>& p = workspace.cgP;
+	Matrix<float, Dynamic, 3>& q = workspace.cgQ;
+
+	//the coordinates are three independent systems with the same matrix, every one gets its own step sizes
+	const Array<float, 1, 3> threshold = cgTolerance * cgTolerance * b.colwise().squaredNorm().array();
+	multiplyFreeLaplacian(x, q);
+	r = b - q;
+	z = r.array().colwise() * sysMatrix.invDiag.array();
+	p = z;
+	Array<float, 1, 3> rz = (r.array() * z.array()).colwise().sum();
+
+	for (int k = 0; k < cgMaxIterations; k++) {
+		if ((r.colwise().squaredNorm().array() <= threshold).all())
+			break;
+
+		multiplyFreeLaplacian(p, q);
+		const Array<float, 1, 3> pq = (p.array() * q.array()).colwise().sum();
+		const Array<float, 1, 3> alpha = (pq > 0).select(rz / pq, 0.f); //converged coordinates stop moving
+		x += p * alpha.matrix().asDiagonal();
+		r -= q * alpha.matrix().asDiagonal();
+
+		z = r.array().colwise() * sysMatrix.invDiag.array();
+		const Array<float, 1, 3> rzNext = (r.array() * z.array()).colwise().sum();
+		const Array<float, 1, 3> beta = (rz > 0).select(rzNext / rz, 0.f);
+		p = z + p * beta.matrix().asDiagonal();
+		rz = rzNext;
+	}
+}
+
+void ARAP::ARAPSolver::setConstraintRhs(const std::vector<std::pair<int, Vector3f>>& constraints)
+{
+	if (sysMatrix.isReduced()) { //constraint contribution is the single product -L_fc * x_c
+		//the ring around a region of interest stays where it is in the model, constraints are at their targets
+		const std::vector<Vertex>& vertices = ModelDataPointer->meshes[MeshIndex].vertices;
+		Matrix<float, Dynamic, 3>& x_c = workspace.x_c;
+		x_c.resize(sysMatrix.fixedVertices.size(), 3);
+		for (int col = 0; col < sysMatrix.fixedVertices.size(); col++) {
+			const glm::vec3& p = vertices[sysMatrix.fixedVertices[col]].Position;
+			x_c.row(col) << p.x, p.y, p.z;
+		}
+		for (int i = 0; i < constraints.size(); i++)
+			if (sysMatrix.conColumns[i] >= 0)
+				x_c.row(sysMatrix.conColumns[i]) = constraints[i].second;
+		constraintRhs.setZero(sysMatrix.L_fc.rows(), 3);
+		constraintRhs.noalias() -= sysMatrix.L_fc * x_c;
+		return;
+	}
+
+	constraintRhs.setZero(restPos.rows(), 3);
+
+	//move known constraint positions to the rhs of the system
 	for (const auto& con : constraints) {
 		const auto idx = con.first;
 		
@@ -267,22 +1795,130 @@ void ARAP::ARAPSolver::solvePositions(const std::vector<std::pair<int, Vector3f>
 
 		// loop through fan
 		for (size_t jj = weight_idx_start; jj < weight_idx_end; jj++) {
-			const float weight = -edgeWeights.weights[jj].weight;
-			const auto u_handle = edgeWeights.weights[jj].vertex;
-			const auto u_idx = u_handle.idx();
+			const float weight = -edgeWeights.weights[jj];
+			const int u_idx = edgeWeights.neighbors[jj];
 
-			b.row(u_idx) -= weight * con.second;
+			constraintRhs.row(u_idx) -= weight * con.second;
 		}
 	}
+}
+
+void ARAP::ARAPSolver::resetAnderson()
+{
+	workspace.aaCount = 0;
+	workspace.aaNext = 0;
+	workspace.aaHasPrev = false;
+	workspace.aaPending = false;
+}
+
+bool ARAP::ARAPSolver::andersonStep(Matrix<float, Dynamic, 3>& pos)
+{
+	SolverWorkspace& ws = workspace;
+	const Index n = pos.size();
+	Map<VectorXf> x(pos.data(), n);
+	Map<VectorXf> f(ws.aaPos.data(), n);
+	Map<VectorXf> g(ws.aaPlain.data(), n);
+	Map<VectorXf> prevF(ws.aaPrevF.data(), n);
+	Map<VectorXf> prevG(ws.aaPrevG.data(), n);
+
+	//residual of the fixed point iteration x_k+1 = G(x_k)
+	g = x;
+	f = g - f;
+
+	if (ws.aaHasPrev) {
+		ws.aaDF.col(ws.aaNext) = f - prevF;
+		ws.aaDG.col(ws.aaNext) = g - prevG;
+		ws.aaNext = (ws.aaNext + 1) % andersonWindow;
+		ws.aaCount = std::min(ws.aaCount + 1, andersonWindow);
+	}
+	prevF = f;
+	prevG = g;
+	ws.aaHasPrev = true;
+
+	if (ws.aaCount == 0)
+		return false;
+
+	//theta = argmin |f_k - DF * theta|, via the normal equations of at most andersonMaxWindow unknowns
+	const int m = ws.aaCount;
+	Matrix<double, Dynamic, Dynamic, 0, andersonMaxWindow, andersonMaxWindow> M(m, m);
+	Matrix<double, Dynamic, 1, 0, andersonMaxWindow, 1> rhs(m);
+	for (int i = 0; i < m; i++) {
+		rhs(i) = ws.aaDF.col(i).dot(f);
+		for (int j = 0; j <= i; j++)
+			M(i, j) = M(j, i) = ws.aaDF.col(i).dot(ws.aaDF.col(j));
+	}
+	M.diagonal().array() += 1e-10 * M.trace() + std::numeric_limits<double>::min(); //regularize nearly dependent columns
+	const Matrix<float, Dynamic, 1, 0, andersonMaxWindow, 1> theta = M.ldlt().solve(rhs).cast<float>();
+
+	//x_k+1 = G(x_k) - DG * theta
+	x = g;
+	x.noalias() -= ws.aaDG.leftCols(m) * theta;
+	return true;
+}
+
+void ARAP::ARAPSolver::solvePositions(const std::vector<std::pair<int, Vector3f>>& constraints, const vector_Matrix3f& rotations, Matrix<float, Dynamic, 3>& solvedPos)
+{
+	const size_t vertexCount = restPos.rows();
+
+	//calc rhs b with the precomputed operator. Column major Matrix3f storage of the rotations
+	//read row major is exactly the stack of the transposed rotations
+	Map<const Matrix<float, Dynamic, 3, RowMajor>> R(rotations[0].data(), 3 * vertexCount, 3);
+
+	//buffers keep their size until the constraint set changes, the solves write into them in place
+	Matrix<float, Dynamic, 3>& b_f = workspace.b_f;
+	Matrix<float, Dynamic, 3>& x_f = workspace.x_f;
+
+	if (sysMatrix.isReduced()) {
+		//only the rows of K of free vertices, constraint contribution is cached in constraintRhs
+		const int freeCount = sysMatrix.freeVertices.size();
+		b_f.resize(freeCount, 3);
+#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+		for (int i = 0; i < freeCount; i++) {
+			RowVector3f b_i = constraintRhs.row(i);
+			if (memoryLean)
+				b_i += rhsRow(sysMatrix.freeVertices[i], rotations);
+			else
+				for (SparseMatrix<float, RowMajor>::InnerIterator it(sysMatrix.K, sysMatrix.freeVertices[i]); it; ++it)
+					b_i += it.value() * R.row(it.col());
+			b_f.row(i) = b_i;
+		}
+
+		//solve for free vertices, constrained vertices are at their targets. The current pos is the initial guess of iterative backends
+		x_f.resize(freeCount, 3);
+		if (sysMatrix.type == LinearSolver::ConjugateGradient)
+			for (int i = 0; i < freeCount; i++)
+				x_f.row(i) = solvedPos.row(sysMatrix.freeVertices[i]);
+		solveSystemMatrix(b_f, x_f);
+		solvedPos.resize(vertexCount, 3);
+		for (int i = 0; i < freeCount; i++)
+			solvedPos.row(sysMatrix.freeVertices[i]) = x_f.row(i);
+		for (int i = 0; i < constraints.size(); i++)
+			if (sysMatrix.conColumns[i] >= 0)
+				solvedPos.row(constraints[i].first) = constraints[i].second;
+		return;
+	}
+
+	//apply constraints to system, their contribution is cached in constraintRhs
+	Matrix<float, Dynamic, 3>& b = workspace.b;
+	if (memoryLean) {
+#pragma omp parallel for schedule(dynamic, rotationChunkSize) num_threads(activeThreads())
+		for (int v = 0; v < (int)vertexCount; v++)
+			b.row(v) = rhsRow(v, rotations);
+	}
+	else
+		b.noalias() = sysMatrix.K * R;
+	b += constraintRhs;
 	for (const auto& con : constraints)
 		b.row(con.first) = con.second;
-
-	//solve
-	Matrix<float, Dynamic, 3> x;
-	x = sysMatrix.solver.solve(b);
-	solvedPos.clear();
-	for (size_t i = 0; i < vertexCount; i++)
-		solvedPos.push_back(x.row(i));
+	for (int v : components.idleVertices)
+		b.row(v) = solvedPos.row(v);
+
+	//solve in the fill-reducing ordering
+	b_f.resize(vertexCount, 3);
+	x_f.resize(vertexCount, 3);
+	b_f = sysMatrix.P * b;
+	solveSystemMatrix(b_f, x_f);
+	solvedPos = sysMatrix.Pinv * x_f;
 }
 
 
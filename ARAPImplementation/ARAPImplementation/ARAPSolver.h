@@ -3,78 +3,351 @@
 //#include "VertexDragging.h"
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <numeric>
+#include <algorithm>
 #include <Eigen/Dense>
 #include <Eigen/SparseCore>
 #include <Eigen/SparseCholesky>
+#ifdef ARAP_USE_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
 #include <iostream>
+#include <chrono>
+#include <atomic>
 #include "eigen_containers.hpp"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace Eigen;
 
 namespace ARAP {
 
+	//backends for the linear solve of the global step, selectable at runtime
+	enum class LinearSolver {
+		SimplicialLLT, // sparse Cholesky factorization (default)
+		SimplicialLDLT, // sparse LDL^T factorization, no square roots
+		SupernodalLLT, // CHOLMOD supernodal Cholesky, only available if built with ARAP_USE_CHOLMOD. Factorizes in double precision
+		ConjugateGradient // matrix-free Jacobi preconditioned CG on the fans, warm-started from the current pos. Always solves the reduced system
+	};
+
+	//fill-reducing orderings of the system of the global step, selectable at runtime
+	enum class FillOrdering {
+		AMD, // approximate minimum degree (default)
+		COLAMD, // column approximate minimum degree of the symmetric pattern
+		NestedDissection, // recursive vertex separators from breadth first level structures of the mesh graph, suits large nearly planar meshes
+		Natural, // vertex order of the mesh, e.g. from the load-time reordering. Far more fill, and with it more round-off in single precision
+		Automatic // the candidate with the fewest estimated factorization flops on the whole mesh, chosen once per mesh. Natural is only tried on reordered meshes
+	};
+
+	//cost of the last factorization of the global step
+	struct FactorizationStats {
+		FillOrdering ordering = FillOrdering::AMD; // ordering in use, never Automatic
+		int rows = 0; // size of the factorized system
+		size_t nonZeros = 0; // entries of the factor L, diagonal included
+		double flops = 0; // estimated multiply-adds of the numeric factorization, the sum of the squared column counts of L
+		float analyzeMs = 0; // symbolic analysis, 0 if the previous one was reused
+		float factorizeMs = 0; // numeric factorization
+	};
+
 	//struct for the systemMatrix that is needed to solve for positions
 	struct SystemMatrix {
-		Eigen::SparseMatrix<float> L_orig; // the original system matrix
-		Eigen::SparseMatrix<float> L; // the system matrix with constraints applied
-		Eigen::SimplicialLLT<Eigen::SparseMatrix<float>> solver; // solver, stores a reference to L.
-	};
+		Eigen::SparseMatrix<float> L; // the system matrix with constraints applied, lower triangle only. In reduced mode only the free block L_ff, in masked mode all of P * L * P^T
+		Eigen::SparseMatrix<float> L_fc; // reduced mode: coupling of free rows to constrained columns, moves the constraints to the rhs
+		Eigen::SparseMatrix<float, Eigen::RowMajor> K; // constant rhs operator: b = K * R, R stacks the transposed rotations of all vertices (3n x 3)
+		LinearSolver type = LinearSolver::SimplicialLLT; // backend used for factorizing and solving
+		Eigen::SimplicialLLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::NaturalOrdering<int>> solver; // solver, stores a reference to L. Matrices are pre-ordered by P
+		Eigen::SimplicialLDLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::NaturalOrdering<int>> ldlt; // LDL^T backend, same ordering
+#ifdef ARAP_USE_CHOLMOD
+		Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double>> supernodal; // CHOLMOD only supports double. Applies its own ordering on top of P
+#endif
+		Eigen::VectorXf invDiag; // conjugate gradient: inverse diagonal of L_ff, the Jacobi preconditioner. Replaces the assembled L_ff
+
+		// level schedule of the triangular solves with the simplicial factor, rebuilt after every factorization. The rows of a level do not depend on each other
+		std::vector<int> forwardLevels, forwardRows; // level k of L * y = b holds the rows forwardRows[forwardLevels[k] .. forwardLevels[k + 1])
+		std::vector<int> backwardLevels, backwardRows; // the same for L^T * x = y
+		Eigen::SparseMatrix<float, Eigen::RowMajor> factorRows; // copy of the factor in row major form, the forward substitution reads it row by row
+		Eigen::VectorXf factorD; // LDLT: the diagonal D, the factor itself has a unit diagonal
+		float levelParallelShare = 0; // share of the rows in levels of at least levelParallelRows rows, the part of the substitutions that runs in parallel
+		FactorizationStats stats; // fill, flops and time of the last factorization
+
+		FillOrdering ordering = FillOrdering::AMD; // selected ordering, stats.ordering holds the one Automatic picked
+		Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> P; // fill-reducing ordering, computed once: maps vertex index to row in the masked system
+		Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> Pinv; // maps row in the masked system to vertex index
+		bool maskedPatternAnalyzed = false; // the pattern of the masked system does not depend on the constraints, so the symbolic factorization is done only once
 
-	struct FanWeight {
-		OpenMesh::VertexHandle vertex; // The vertex index of the vertex in the Mesh.
-		float weight; // The corresponding weight.
+		bool reduced = false; // eliminate constrained vertices from the system instead of zeroing their rows and columns. Off by default: the masked pattern is analyzed once for all toggles
+		bool regional = false; // a region of interest is active, only its vertices are free
+		std::vector<int> freeIdx; // reduced mode: maps vertex index to row in L_ff, -1 for constrained (or with a region of interest: outside) vertices
+		std::vector<int> freeVertices; // reduced mode: maps row in L_ff to vertex index
+		std::vector<int> fixedVertices; // reduced mode: maps column in L_fc to vertex index, the constraints and the ring around the region of interest
+		std::vector<int> conColumns; // reduced mode: column in L_fc of every constraint, -1 for constraints outside of the region of interest
+
+		bool isReduced() const { return reduced || regional || type == LinearSolver::ConjugateGradient; } // the free block is solved, constraints are on the rhs
 	};
 
+	//fans of all vertices in compressed sparse row form
 	struct FanWeights {
-		// maps from 'vertex index in mesh' to index into 'weights' vector. For each vertex, we can get the outgoing edges and their weights.
+		// maps from 'vertex index in mesh' to index into 'neighbors' and 'weights'. For each vertex, we can get the outgoing edges and their weights.
 		// The number of neighbors for a vertex is implicitly given by 'offsets[idx+1] - offsets[idx]'
 		std::vector<size_t> offsets;
 
-		// The edge weights.
+		// The vertex index of the neighbor in the Mesh and the corresponding edge weight.
 		// If a vertex has multiple neighbors, they are stored consecutively.
-		std::vector<FanWeight> weights;
+		std::vector<int> neighbors;
+		std::vector<float> weights;
+
+		// The weighted rest pose edges w * (p_u - p_v), one row per fan entry, aligned with 'weights'.
+		// Constant for the lifetime of the solver, the local step streams them instead of reading the mesh.
+		Matrix<float, Dynamic, 3> restEdges;
+
+		// SUM(w * |p_u - p_v|^2) over the fan of each vertex, the constant part of the ARAP energy of the fan.
+		std::vector<float> restEnergy;
+	};
+
+	//vertices of the mesh grouped into SIMD batches for the local step. All vertices of a batch have the same valence,
+	//so every lane walks its fan in lockstep
+	struct RotationBatches {
+		static const int width = 8; // lanes per batch, one AVX register of floats or two SSE registers
+
+		// batch b holds the vertex indices vertices[b * width .. (b + 1) * width). Unused lanes of the last batch of a valence are -1
+		std::vector<int> vertices;
+	};
+
+	//connected components of the mesh, e.g. separate shells of clothing. Components without constraints are not solved: they would be singular
+	//and nothing moves them anyway
+	struct Components {
+		std::vector<int> of; // component of every vertex, computed at load time
+		int count = 0;
+		std::vector<char> active; // component contains a constraint
+		std::vector<int> idleVertices; // vertices of components without constraints
+		RotationBatches batches; // vertices of the active components grouped for the local step, used if there are idle vertices
+	};
+
+	//part of the mesh that is deformed, the rest stays where it is. Either an explicit selection or the rings around the constraints
+	struct RegionOfInterest {
+		int rings = 0; // automatic region: vertices at most rings edges away from a constraint. 0 = explicit selection
+		std::vector<int> selection; // explicit region, empty = whole mesh unless rings > 0
+
+		// the current region, rebuilt only if the constraints leave it, so that repeated edits in the same area reuse it
+		std::vector<int> vertices; // vertices of the region, solved for unless constrained
+		std::vector<int> ring; // vertices outside of the region with a neighbor inside, fixed where they are
+		std::vector<char> inside; // per vertex of the mesh: vertex is in the region
+		RotationBatches batches; // the region and its ring grouped for the local step, the ring supplies the rotations for the rhs of the region
+		bool valid = false; // vertices, ring and batches belong to the current settings
+
+		bool enabled() const { return rings > 0 || !selection.empty(); }
+	};
+
+	//one simplified level of the hierarchy: clusters of the vertices of the next finer level, connected where their members share an edge.
+	//Solved with the plain local/global steps, its change over an ArapStep is prolongated to the finer level by blending the rigid motions of the clusters around every vertex
+	struct HierarchyLevel {
+		std::vector<int> parent; // maps each vertex of the next finer level (the mesh for the first level) to its cluster
+		FanWeights fans; // graph of the clusters in the same form as the fans of the mesh. Weights sum the fine edges between two clusters
+		Matrix<float, Dynamic, 3> restPos; // rest position of every cluster, the mean of its members
+		Matrix<float, Dynamic, 3> pos, prevPos; // current pose, and the pose at the start of the ArapStep for the prolongation
+		vector_Matrix3f rotations, prevRotations; // the same for the rotations of the local step
+
+		std::vector<int> component; // connected component of the mesh of every cluster, clusters never span two
+		std::vector<int> order; // clusters in fill-reducing order of the level's Laplacian, computed once. L_ff keeps their relative order
+		std::vector<int> freeIdx; // maps cluster to row in L_ff, -1 for clusters that contain a constrained vertex
+		std::vector<int> freeClusters; // maps row in L_ff to cluster
+		std::vector<int> conClusters; // maps column in L_fc to cluster
+		std::vector<int> conColumns; // maps constraint to the column in L_fc of its cluster
+		std::vector<int> conMembers; // constraints per column in L_fc
+		Eigen::SparseMatrix<float> L_fc;
+		Eigen::SimplicialLLT<Eigen::SparseMatrix<float>, Eigen::Lower, Eigen::NaturalOrdering<int>> solver; // factorization of L_ff, pre-ordered by order
+		size_t factorNonZeros = 0; // entries of the factor
+		Matrix<float, Dynamic, 3> b_f, x_f, x_c; // rhs and solution of the free clusters, targets of the constrained clusters
+	};
+
+	//result of one ArapStep call
+	struct ArapStepResult {
+		int iterations = 0; // local/global iterations that were run
+		float energy = 0; // ARAP energy evaluated in the last local step, an upper bound for the energy of the returned pose
+		bool converged = false; // relative energy decrease dropped below the tolerance
+	};
+
+	//buffers of the solver, sized once per mesh (or constraint set) so that ArapStep does not allocate in steady state
+	struct SolverWorkspace {
+		Matrix<float, Dynamic, 3> pos; // positions of the current iteration
+		vector_Matrix3f rotations; // rotations of the last local step, warm start for the next one
+		Matrix<float, Dynamic, 3> b; // rhs of all vertices
+		Matrix<float, Dynamic, 3> b_f; // rhs of the reduced system, permuted rhs in masked mode
+		Matrix<float, Dynamic, 3> x_f; // solution of the reduced system, permuted solution in masked mode
+		Matrix<float, Dynamic, 3> x_c; // constraint targets, one row per constraint
+
+		// Anderson acceleration, only allocated if enabled. Positions are flattened to one vector of 3n entries
+		Matrix<float, Dynamic, 3> aaPos; // x_k, pos before the global step. Overwritten with the residual f_k = G(x_k) - x_k
+		Matrix<float, Dynamic, 3> aaPlain; // G(x_k), the plain global step. Fallback if the accelerated pos raises the energy
+		Matrix<float, Dynamic, 3> aaPrevF, aaPrevG; // f_k-1 and G(x_k-1)
+		Matrix<float, Dynamic, Dynamic> aaDF, aaDG; // ring buffer of the differences of successive residuals and global steps, one per column
+		int aaCount = 0; // valid columns in aaDF, aaDG
+		int aaNext = 0; // column that is overwritten next
+		bool aaHasPrev = false; // aaPrevF, aaPrevG are valid
+		bool aaPending = false; // pos holds the extrapolation of the last ArapStep, whose energy was not checked. The model got aaPlain
+
+		// conjugate gradient: residual, preconditioned residual, search direction and its image under L_ff
+		Matrix<float, Dynamic, 3> cgR, cgZ, cgP, cgQ;
+
+		// temporal prediction, only allocated if enabled
+		Matrix<float, Dynamic, 3> prevPos; // pose returned by the second to last ArapStep, the last one is still in the model
+		Matrix<float, Dynamic, 3> predPos; // extrapolated initial guess for the current ArapStep
+		Matrix<float, Dynamic, 3> coarsePos; // initial guess prolongated from the hierarchy
+		vector_Matrix3f predRotations; // rotations of the local step on predPos or coarsePos
 	};
 
 	class ARAPSolver
 	{
 	public:
 		//Data
-		Model * ModelDataPointer; //Mesh to be rendered
-		TriMesh OrigMesh; //Original Mesh in base position. Used as initial guess for rotation solving
+		Model * ModelDataPointer; //Model to be rendered
+		int MeshIndex; //mesh of the model deformed by this solver, one solver per mesh
 
 		//constructor
-		ARAPSolver(Model* parsedModel, TriMesh& origMesh);
+		//ordering: fill-reducing ordering of the first system, so an Automatic choice is not preceded by a wasted AMD
+		//reportFactorizations: see setFactorizationReport, as a parameter it also covers the candidates Automatic measures in here
+		ARAPSolver(Model* parsedModel, const TriMesh& origMesh, int meshIndex = 0, FillOrdering ordering = FillOrdering::AMD, bool reportFactorizations = false);
+		ARAPSolver(Model* parsedModel, int meshIndex, FillOrdering ordering = FillOrdering::AMD, bool reportFactorizations = false); //rest pose and connectivity taken from the mesh itself
 		~ARAPSolver();
 		
 		//performs ARAP algorithm and calculations rigid deformation. Constraints have to be toggled beforehand and their positions (from dragging) updated.
-		void ArapStep(int iterations);
+		//Stops after maxIterations or as soon as an iteration lowers the ARAP energy by less than tolerance (relative).
+		//With a budgetMs > 0 it also stops before an iteration that would exceed the budget, later calls continue from there.
+		//Does nothing if the last call converged and no constraint changed since.
+		//Writes the new pose into the vertices of the mesh but does not upload them (iterations > 0), so solvers of different meshes can run concurrently
+		ArapStepResult ArapStep(int maxIterations, float tolerance = 0.f, float budgetMs = 0.f);
 
 		void toggleConstraint(int idx); //registers vertex with id idx as a constraint that is not moved by the algorithm
 		void untoggleConstraint(int i); //remove constraint i from the constraint list
 		void UpdateConstraint(int idx, glm::vec3 pos); //updates the position of a vertex with id idx that is a registered constraint with the new pos
 
+		void setReducedSystem(bool reduced); //solve only for free vertices, or for all vertices with masked constraint rows (default). The reduced system is smaller but analyzed again on every toggle
+		bool setLinearSolver(LinearSolver type); //select the backend of the global step. Returns false if it is not available in this build
+		void setThreadCount(int threads); //number of threads for the parallel solver stages, 0 uses all available cores
+		void setAndersonAcceleration(int window); //accelerate the local/global iteration with a history of window steps (max andersonMaxWindow), 0 disables it
+		void setTemporalPrediction(bool enable); //seed the solve of moved handles with the pose extrapolated from the last two frames instead of the last pose
+		void setRegionOfInterest(const std::vector<int>& vertices); //deform only these vertices, the rest of the mesh stays where it is. Empty = whole mesh
+		void setRegionOfInterestRings(int rings); //deform only the vertices within rings edges of the constraints, 0 = whole mesh
+		void setCancelFlag(const std::atomic<bool>* flag); //ArapStep returns after the current iteration once *flag is set, the next call continues from there. nullptr disables it
+		void setMemoryLean(bool lean); //drop the data that only buys speed: the rhs operator K (the rhs is evaluated from the rest edges) and the row copy of the factor (serial substitutions)
+		size_t memoryUsage() const; //bytes held by the solver: rest state, system, factor, workspace and hierarchy. CHOLMOD's factor is not included
+		void setHierarchyLevels(int levels); //build up to levels coarse levels (at load time) that spread the motion of moved handles before the fine iterations, 0 disables them
+		void setFillOrdering(FillOrdering ordering); //select the fill-reducing ordering of the global step, recomputed right away
+		void setFactorizationReport(bool enable); //print ordering, nnz(L), estimated flops and time of every factorization to std::cout. The candidates of Automatic only through the constructor
+		const FactorizationStats& factorizationStats() const; //cost of the last factorization of the global step
+
 	private:
 		SystemMatrix sysMatrix;
 
 		std::vector<std::pair<int, Vector3f>> constraints; //constraint list: idx of vertex, vertex pos
-		bool changedConstraints = false; //if we change pos of membership of our constraint list, we have to update our SystemMatrix
+		bool changedConstraintSet = false; //membership of our constraint list changed: the SystemMatrix has to be rebuilt and refactorized
+		bool movedConstraints = false; //target pos of constraints changed: only the constraint part of the rhs has to be updated
+		Matrix<float, Dynamic, 3> constraintRhs; //contribution of the constraint targets to the rhs, cached until constraints are moved
+		Matrix<float, Dynamic, 3> restPos; //rest positions of the mesh, one column per coordinate
 		FanWeights edgeWeights; // calculate weights of mesh
+		RotationBatches rotationBatches; // vertices grouped by valence for the batched local step
+		RegionOfInterest region; // active part of the mesh, whole mesh if disabled
+		Components components; // connected components, only the ones with constraints are solved
+		SolverWorkspace workspace; // persistent buffers of ArapStep
+		float lastEnergy = -1; //energy of the pose returned by the last ArapStep, -1 if the constraints changed since
+		bool lastConverged = false; //the last ArapStep converged, nothing to do until the constraints change
+		const std::atomic<bool>* cancelFlag = nullptr; //set by another thread to preempt ArapStep, e.g. by newer input
+		float iterationMs = 0; //running average of the time of one local/global iteration, estimates if the next one fits into the budget
+
+		bool memoryLean = false; //no K and no factorRows, see setMemoryLean
+		bool reportFactorizations = false; //print the stats of every factorization
 
+		int threadCount = 0; //threads used for the parallel solver stages, 0 = all available
+		static const int rotationChunkSize = 256; //vertices per dynamically scheduled chunk of the local step, keeps threads balanced on irregular valence
+		static const int rotationMaxIterations = 16; //max iterations of the batched rotation extraction, lanes that did not converge fall back to the SVD
+		static constexpr float rotationTolerance = 1e-5f; //angle in radians below which the batched rotation extraction counts as converged
+
+		int andersonWindow = 0; //history size of the Anderson acceleration, 0 = plain local/global iteration
+		static const int andersonMaxWindow = 16; //upper bound of andersonWindow, keeps the small least squares system on the stack
+
+		static const int cgMaxIterations = 200; //max iterations of the conjugate gradient backend per global step
+		static constexpr float cgTolerance = 1e-5f; //residual of the conjugate gradient backend relative to the rhs, per coordinate
+		static const int levelParallelRows = 64; //levels of the triangular solves with fewer rows are substituted serially, not worth waking the threads
+		static constexpr float levelScheduleMinSpeedup = 2.0f; //estimated speedup of the level scheduled substitutions needed to use them, they run slower than Eigen's on one thread
+		static const int dissectionLeafSize = 32; //nested dissection stops splitting parts of at most this many vertices
+
+		bool temporalPrediction = false; //extrapolate the initial guess while handles are dragged
+		bool predictionValid = false; //workspace.prevPos holds a pose solved for the current constraint set
+
+		std::vector<std::unique_ptr<HierarchyLevel>> hierarchy; //coarse levels, hierarchy[0] clusters the mesh. Empty if disabled
+		static const int hierarchyMinVertices = 64; //no level is coarser than this, small meshes get no hierarchy at all
+		static const int hierarchyMaxIterations = 200; //local/global iterations per coarse level and ArapStep at most
+		static constexpr float hierarchyTolerance = 1e-5f; //a coarse level is converged once an iteration lowers its energy by less than this (relative)
+
+		static TriMesh triMeshFromMesh(const Mesh& mesh); //connectivity of a rendered mesh, vertex ids are the indices into its vertex array
 		Vector3f vector3f_from_point(const TriMesh::Point& p); //converts a TriMeshPoint into Vector3f
 		float compute_weight(TriMesh::Point v, TriMesh::Point u, TriMesh::Point other); //compute weight from two points
-		FanWeights computeFanWeights(); //compute all weights
+		FanWeights computeFanWeights(const TriMesh& mesh); //compute all weights
+		void sortFan(int v, std::vector<size_t>& fan) const; //fan entries of v ordered by neighbor, for writing its row straight into a compressed matrix
+		RotationBatches computeRotationBatches(const std::vector<int>& vertices); //group vertices with the same valence into batches
+		void computeComponents(); //label the connected components of the mesh
+		void updateComponents(); //find the components with constraints, the vertices of the others are left out of the local and global steps
+		void updateRegion(); //rebuild the region of interest for the current constraints, keeps the current one if it still contains them
+
+		//solve target rotations from original Mesh frame pose (restEdges of edgeWeights). Initial Guess: previous frame (targetPos), solved Rotations in solvedRotations.
+		//Returns the ARAP energy of targetPos as a by-product
+		float solveRotations(vector_Matrix3f& solvedRotations, const Matrix<float, Dynamic, 3>& targetPos);
 
-		//solve target rotations from original Mesh frame pose. Initial Guess: previous frame (targetPos), solved Rotations in solvedRotations
-		void solveRotations(const TriMesh &mesh, vector_Matrix3f& solvedRotations, const vector_Vector3f& targetPos);
+		//solve the rotations of one batch of vertices in structure of arrays form. Rotations in solvedRotations are the warm start.
+		//Agrees with the procrustes SVD up to rotationTolerance, lanes that do not converge or stop at a saddle are solved with procrustes directly.
+		//Returns the summed ARAP energy of the fans in the batch
+		float solveRotationBatch(const int* batch, vector_Matrix3f& solvedRotations, const Matrix<float, Dynamic, 3>& targetPos);
 		
-		//solve for rotation matrices from base mesh pose to target mesh pose with the procrusts algorithm
-		Eigen::Matrix3f procrustes(const vector_Vector3f& sourcePoints, const vector_Vector3f& targetPoints, const std::vector<float>& weights);
+		//solve for rotation matrix from base mesh pose to target mesh pose with the procrusts algorithm.
+		//Takes the weighted 3x3 covariance of a fan, works on fixed size matrices only and never allocates
+		Eigen::Matrix3f procrustes(const Eigen::Matrix3f& covariance);
+		static bool isTraceMaximum(const Eigen::Matrix3f& R, const Eigen::Matrix3f& A); //a converged R of the batched extraction is the maximum of tr(R^T A), not a saddle
 		
 		void computeSystemMatrix(SystemMatrix& mat); //compute system Matrix L for solving of the new Positions
-		void setSystemMatrixConstraints(const std::vector<std::pair<int, Vector3f>>& constraints); //update system matrix if we changed out constraints (membership/ pos)
+		void computeFillOrdering(const SparseMatrix<float>& L, FillOrdering ordering, PermutationMatrix<Dynamic, Dynamic, int>& P); //fill-reducing ordering of L (lower triangle, vertex order), P maps vertex index to row
+		std::vector<int> nestedDissection() const; //vertices in nested dissection order of the mesh graph, separators after the parts they split
+		//symbolic Cholesky of P * L * P^T on the fans: entries and flops of the factor. Gives up and returns false as soon as the flops exceed flopLimit (if >= 0)
+		bool factorCost(const PermutationMatrix<Dynamic, Dynamic, int>& P, size_t& nonZeros, double& flops, double flopLimit = -1) const;
+		void reportFactorization() const; //print sysMatrix.stats
+		static const char* orderingName(FillOrdering ordering);
+		void computeRhsOperator(SystemMatrix& mat); //compute operator K that maps the rotations to the rhs, holds the rest pose edges and weights
+		RowVector3f rhsRow(int v, const vector_Matrix3f& rotations) const; //row v of K * R straight from the rest edges, used instead of K in the lean mode
+		void setSystemMatrixConstraints(const std::vector<std::pair<int, Vector3f>>& constraints); //update system matrix if we changed the membership of our constraints
+		void assembleMaskedSystemMatrix(const std::vector<int>& conIdx); //lower triangle of P * L * P^T with the rows and columns of constrained vertices (conIdx >= 0) masked
+		void setConstraintRhs(const std::vector<std::pair<int, Vector3f>>& constraints); //update constraint part of the rhs if we moved our constraints
+
+		void analyzeSystemMatrix(const SparseMatrix<float>& L); //symbolic factorization of L with the selected direct backend
+		void factorizeSystemMatrix(const SparseMatrix<float>& L); //numeric factorization of L with the selected direct backend, reuses the symbolic one
+		void solveSystemMatrix(const Matrix<float, Dynamic, 3>& b, Matrix<float, Dynamic, 3>& x); //x = L^-1 * b with the selected backend. x is the initial guess of the conjugate gradient
+		const SparseMatrix<float>& factorMatrix() const; //lower triangular factor of the selected simplicial backend, in column major form
+		void computeLevelSchedule(); //group the rows of the factor into levels of independent rows for the parallel triangular solves
+		void solveLevelScheduled(const Matrix<float, Dynamic, 3>& b, Matrix<float, Dynamic, 3>& x); //x = L^-1 * b with the simplicial factor, the rows of each level in parallel
+		void multiplyFreeLaplacian(const Matrix<float, Dynamic, 3>& x, Matrix<float, Dynamic, 3>& y); //y = L_ff * x without assembling L_ff, straight from the fans
+		void solveConjugateGradient(const Matrix<float, Dynamic, 3>& b, Matrix<float, Dynamic, 3>& x); //Jacobi preconditioned CG on L_ff, all three coordinates at once
+
+		int activeThreads() const; //threads of the parallel stages: threadCount, or all available if 0. 1 without OpenMP
+
+		void resetAnderson(); //drop the Anderson history, e.g. when the fixed point map changed
+		//store pos = G(x_k) as the plain step and replace it by the Anderson extrapolation from the history. x_k is expected in workspace.aaPos.
+		//Returns false if there was no history yet and pos was left untouched
+		bool andersonStep(Matrix<float, Dynamic, 3>& pos);
+
+		//replace the initial guess pos by its velocity extrapolation pos + (pos - prevPos) and/or the prolongation of the hierarchy if that has the lower energy.
+		//Runs the first local step on all guesses, rotations and the returned energy belong to the chosen one
+		float selectInitialGuess(Matrix<float, Dynamic, 3>& pos, bool extrapolate, bool coarse);
+		void placeConstraintTargets(Matrix<float, Dynamic, 3>& pos) const; //move the constrained vertices of pos to their targets, constraints outside of the region of interest stay
+
+		std::unique_ptr<HierarchyLevel> coarsenLevel(const FanWeights& fans, const Matrix<float, Dynamic, 3>& fineRestPos, const std::vector<int>& fineComponent); //cluster every vertex with its unclustered 1-ring
+		void setHierarchyConstraints(); //find the constrained clusters of every level and factorize their L_ff
+		void solveHierarchy(); //iterate the levels coarse to fine, every level starts from the prolongated change of the coarser one
+		//apply the rigid change of the clusters over the current ArapStep to the vertices of the finer level: x' = c' + R' * R^T * (x - c),
+		//averaged over the clusters of the vertex and its neighbors in fineFans so that cluster borders stay smooth. In place if finePos and prolongated are the same
+		void prolongate(const HierarchyLevel& coarse, const FanWeights& fineFans, const Matrix<float, Dynamic, 3>& finePos, Matrix<float, Dynamic, 3>& prolongated);
 
 		//solve for new Positions (solvedPos) by updating the rhs of our equation system with the previously solved rotations and updating rhs with our constraints
-		void solvePositions(const std::vector<std::pair<int, Vector3f>>& constraints, const vector_Matrix3f& rotations, vector_Vector3f& solvedPos);
+		void solvePositions(const std::vector<std::pair<int, Vector3f>>& constraints, const vector_Matrix3f& rotations, Matrix<float, Dynamic, 3>& solvedPos);
 
 	};
 
@@ -0,0 +1,156 @@
+#pragma once
+#include "AsyncARAPSolver.h"
+
+
+
+ARAP::AsyncARAPSolver::AsyncARAPSolver(Model* parsedModel, const TriMesh& origMesh, int meshIndex, FillOrdering ordering, bool reportFactorizations)
+{
+	ModelDataPointer = parsedModel;
+	MeshIndex = meshIndex;
+	shadowModel.meshes.push_back(parsedModel->meshes[meshIndex]);
+	arap = std::make_unique<ARAPSolver>(&shadowModel, origMesh, 0, ordering, reportFactorizations);
+	init();
+}
+
+ARAP::AsyncARAPSolver::AsyncARAPSolver(Model* parsedModel, int meshIndex, FillOrdering ordering, bool reportFactorizations)
+{
+	ModelDataPointer = parsedModel;
+	MeshIndex = meshIndex;
+	shadowModel.meshes.push_back(parsedModel->meshes[meshIndex]);
+	arap = std::make_unique<ARAPSolver>(&shadowModel, 0, ordering, reportFactorizations);
+	init();
+}
+
+ARAP::AsyncARAPSolver::~AsyncARAPSolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		stopping = true;
+		inputPending = true; //do not finish the running slice
+	}
+	commandSignal.notify_one();
+	if (worker.joinable())
+		worker.join();
+}
+
+void ARAP::AsyncARAPSolver::init()
+{
+	shadowModel.meshes[0].indices = std::vector<unsigned int>(); //the solver has its own connectivity, only the positions are shared
+	shadowModel.meshes[0].textures = std::vector<Texture>(); //originalIndex stays, an Automatic fill ordering checks it
+	arap->setCancelFlag(&inputPending);
+	const Index n = shadowModel.meshes[0].vertices.size();
+	for (int i = 0; i < 3; i++)
+		poses[i].resize(n, 3);
+}
+
+ARAP::ARAPSolver& ARAP::AsyncARAPSolver::solver()
+{
+	return *arap;
+}
+
+size_t ARAP::AsyncARAPSolver::memoryUsage() const
+{
+	size_t bytes = arap->memoryUsage();
+	bytes += shadowModel.meshes[0].vertices.capacity() * sizeof(Vertex); //shadow mesh
+	for (int i = 0; i < 3; i++)
+		bytes += size_t(poses[i].size()) * sizeof(float);
+	return bytes;
+}
+
+void ARAP::AsyncARAPSolver::start(int maxIterations, float tolerance, float sliceMs)
+{
+	if (worker.joinable())
+		return;
+	this->maxIterations = maxIterations;
+	this->tolerance = tolerance;
+	this->sliceMs = sliceMs;
+	worker = std::thread(&AsyncARAPSolver::run, this);
+}
+
+void ARAP::AsyncARAPSolver::toggleConstraint(int idx)
+{
+	queue(Command{ Command::Toggle, idx, glm::vec3(0) });
+}
+
+void ARAP::AsyncARAPSolver::untoggleConstraint(int i)
+{
+	queue(Command{ Command::Untoggle, i, glm::vec3(0) });
+}
+
+void ARAP::AsyncARAPSolver::UpdateConstraint(int idx, glm::vec3 pos)
+{
+	queue(Command{ Command::Update, idx, pos });
+}
+
+void ARAP::AsyncARAPSolver::queue(const Command& command)
+{
+	{
+		std::lock_guard<std::mutex> lock(commandMutex);
+		//a drag sends one target per mouse event, only the newest one per vertex matters
+		if (command.type == Command::Update && !pendingCommands.empty()
+			&& pendingCommands.back().type == Command::Update && pendingCommands.back().idx == command.idx)
+			pendingCommands.back().pos = command.pos;
+		else
+			pendingCommands.push_back(command);
+		inputPending = true;
+	}
+	commandSignal.notify_one();
+}
+
+void ARAP::AsyncARAPSolver::run()
+{
+	std::vector<Command> commands;
+	bool idle = false;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(commandMutex);
+			if (idle) //converged, nothing to do until new input arrives
+				commandSignal.wait(lock, [this] { return stopping || !pendingCommands.empty(); });
+			if (stopping)
+				return;
+			commands.swap(pendingCommands);
+			inputPending = false;
+		}
+
+		for (const Command& command : commands) {
+			switch (command.type) {
+			case Command::Toggle:
+				arap->toggleConstraint(command.idx);
+				break;
+			case Command::Untoggle:
+				arap->untoggleConstraint(command.idx);
+				break;
+			case Command::Update:
+				arap->UpdateConstraint(command.idx, command.pos);
+				break;
+			}
+		}
+		commands.clear();
+
+		//one slice: ends early if new input arrives, the next slice continues from the pose reached so far
+		const ArapStepResult result = arap->ArapStep(maxIterations, tolerance, sliceMs);
+		if (result.iterations > 0)
+			publishPose();
+		idle = result.converged || result.iterations == 0;
+	}
+}
+
+void ARAP::AsyncARAPSolver::publishPose()
+{
+	std::vector<Vertex>& vertices = shadowModel.meshes[0].vertices;
+	Map<Matrix<float, Dynamic, 3, RowMajor>, 0, OuterStride<>> shadowPos(&vertices[0].Position.x, vertices.size(), 3, OuterStride<>(sizeof(Vertex) / sizeof(float)));
+	poses[backPose] = shadowPos;
+	backPose = middlePose.exchange(backPose | freshPose) & poseIndexMask; //release the pose, take the stale one back
+}
+
+bool ARAP::AsyncARAPSolver::fetchPose()
+{
+	if (!(middlePose.load() & freshPose))
+		return false;
+	frontPose = middlePose.exchange(frontPose) & poseIndexMask; //acquire the newest pose, the old front is free for the worker
+
+	std::vector<Vertex>& vertices = ModelDataPointer->meshes[MeshIndex].vertices;
+	Map<Matrix<float, Dynamic, 3, RowMajor>, 0, OuterStride<>> modelPos(&vertices[0].Position.x, vertices.size(), 3, OuterStride<>(sizeof(Vertex) / sizeof(float)));
+	modelPos = poses[frontPose];
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "ARAPSolver.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace ARAP {
+
+	//runs an ARAPSolver on a worker thread. The render thread queues constraint edits and picks up the newest solved pose,
+	//neither of them waits for the other
+	class AsyncARAPSolver
+	{
+	public:
+		//Data
+		Model * ModelDataPointer; //Model to be rendered, only touched by the render thread
+		int MeshIndex; //mesh of the model deformed by this solver
+
+		//constructor
+		AsyncARAPSolver(Model* parsedModel, const TriMesh& origMesh, int meshIndex = 0, FillOrdering ordering = FillOrdering::AMD, bool reportFactorizations = false);
+		AsyncARAPSolver(Model* parsedModel, int meshIndex, FillOrdering ordering = FillOrdering::AMD, bool reportFactorizations = false); //rest pose and connectivity taken from the mesh itself
+		~AsyncARAPSolver(); //preempts the running solve and joins the worker
+
+		ARAPSolver& solver(); //settings of the solver. Only before start(), afterwards the worker owns it
+		size_t memoryUsage() const; //bytes of the solver plus the shadow mesh and the three pose buffers. Only before start()
+		void start(int maxIterations, float tolerance, float sliceMs); //launch the worker. It solves in slices of up to sliceMs and publishes the pose after each slice
+
+		//same as in ARAPSolver, queued for the worker. New input preempts the running slice
+		void toggleConstraint(int idx);
+		void untoggleConstraint(int i);
+		void UpdateConstraint(int idx, glm::vec3 pos);
+
+		//copies the newest finished pose into the vertices of the mesh. Returns false if nothing was published since the last call.
+		//Uploading the vertices is left to the caller
+		bool fetchPose();
+
+	private:
+		struct Command {
+			enum Type { Toggle, Untoggle, Update } type;
+			int idx; // vertex id, constraint index for Untoggle
+			glm::vec3 pos; // target of Update
+		};
+
+		Model shadowModel; //private copy of the deformed mesh, the solver reads and writes it instead of the rendered one
+		std::unique_ptr<ARAPSolver> arap; //only touched by the worker once it runs
+		std::thread worker;
+
+		std::mutex commandMutex; //guards pendingCommands and stopping
+		std::condition_variable commandSignal; //wakes the idle worker
+		std::vector<Command> pendingCommands; //input since the worker last looked
+		bool stopping = false;
+		std::atomic<bool> inputPending{ false }; //cancel flag of the solver: new commands wait
+
+		//lock-free triple buffer of poses: the worker writes backPose, the render thread reads frontPose, they swap with middlePose.
+		//freshPose marks a middlePose that was published but not fetched yet
+		Matrix<float, Dynamic, 3, RowMajor> poses[3];
+		int backPose = 0; //worker only
+		int frontPose = 1; //render thread only
+		std::atomic<int> middlePose{ 2 };
+		static const int freshPose = 4;
+		static const int poseIndexMask = 3;
+
+		int maxIterations = 0;
+		float tolerance = 0;
+		float sliceMs = 0;
+
+		void init(); //shared part of the constructors, after arap is built
+		void queue(const Command& command); //push a command and preempt the worker
+		void run(); //loop of the worker: apply commands, solve a slice, publish
+		void publishPose(); //copy the pose of the shadow mesh into backPose and hand it to the render thread
+	};
+
+}
@@ -8,9 +8,9 @@
 #include "Camera.h"
 #include "MeshLoader.h"
 #include "VertexDragging.h"
-#include "ARAPSolver.h"
+#include "AsyncARAPSolver.h"
+#include <thread>
 #include <memory>
-#include <OpenMesh/Core/IO/MeshIO.hh>
 #include "OpenMeshType.h"
 
 //for transformations
@@ -24,7 +24,7 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 void processInput(GLFWwindow *window);
 
 Camera camera(glm::vec3(0, 0, 15), glm::vec3(0, 1, 0));
-static std::unique_ptr<ARAP::ARAPSolver> arapSolver; //ARAP interface to implement functionality
+static std::vector<std::unique_ptr<ARAP::AsyncARAPSolver>> arapSolvers; //ARAP interface to implement functionality, one solver thread per mesh of the model
 
 //model view prrojection matrices
 glm::mat4 model = glm::mat4(1.0f);
@@ -45,6 +45,13 @@ bool dragging = false;
 
 bool usingCamera = false;
 
+//convergence control of the ARAP solver
+const int arapMaxIterations = 100;
+const float arapTolerance = 1e-3f; //relative energy decrease per iteration below which the pose counts as converged
+const bool reorderOnLoad = true; //rearrange vertices and triangles of the loaded mesh for cache locality
+const float arapSliceMs = 10.0f; //solver time between two published poses, new input ends a slice early
+const bool reportFactorizations = false; //print fill, flops and time of every factorization of the ARAP system, off to keep the console quiet while dragging
+
 
 int main(int argc, char*argv[]) {
 
@@ -103,19 +110,29 @@ int main(int argc, char*argv[]) {
 	const char *fSource = sSource.fragmentSource.c_str();
 	unsigned int shaderProgramBasic = ShaderParser::createShader(vSource, fSource); //create vertex, fragment shaders and link together to program
 
-	//Model parsedModel("data/cactus.obj"); //model to render
-	//vertexDragging::setModel(&parsedModel); //link model for dragging of vertices
-	TriMesh mesh;
-	if (!OpenMesh::IO::read_mesh(mesh, modelPath))
+	Model parsedModel(modelPath, reorderOnLoad); //every mesh of the file is deformed by its own solver, which takes the connectivity from the model
+	if (parsedModel.meshes.empty())
 	{
 		std::cerr << "read mesh error\n";
 		exit(1);
 	}
-	Model parsedModel(mesh);
 	vertexDragging::setModel(&parsedModel); //link model for dragging of vertices
 
-	arapSolver = std::make_unique<ARAP::ARAPSolver>(&parsedModel, mesh);//construct arap interface
-	vertexDragging::setARAP(arapSolver.get());
+	std::vector<ARAP::AsyncARAPSolver*> solverPointers;
+	const int meshCount = parsedModel.meshes.size();
+	for (int m = 0; m < meshCount; m++) {
+		//construct arap interface. The fill ordering is measured on this mesh and the cheapest kept, before the first system is factorized
+		arapSolvers.push_back(std::make_unique<ARAP::AsyncARAPSolver>(&parsedModel, m, ARAP::FillOrdering::Automatic, reportFactorizations));
+		ARAP::ARAPSolver& solver = arapSolvers[m]->solver();
+		solver.setTemporalPrediction(true); //drags are smooth, start each slice from the extrapolated pose
+		solver.setHierarchyLevels(3); //coarse levels for large meshes, small ones get none
+		if (meshCount > 1) //the solver threads of all meshes share the cores
+			solver.setThreadCount(std::max(1, (int)std::thread::hardware_concurrency() / meshCount));
+		std::cout << "ARAP mesh " << m << ": " << arapSolvers[m]->memoryUsage() / std::max<size_t>(1, parsedModel.meshes[m].vertices.size()) << " bytes per vertex before the first factorization, solver thread buffers included" << std::endl;
+		arapSolvers[m]->start(arapMaxIterations, arapTolerance, arapSliceMs);
+		solverPointers.push_back(arapSolvers[m].get());
+	}
+	vertexDragging::setARAP(solverPointers);
 	
 
 	//use model view projection matrices to transform vertices from local to screen (NDC) space. NDC -> ViewPort is done automatically by opengl
@@ -147,8 +164,11 @@ int main(int argc, char*argv[]) {
 		if(usingCamera)
 			view = camera.getViewMatrix();
 
-		//ARAP
-		arapSolver->ArapStep(3);
+		//ARAP: the solver threads iterate until the energy stagnates and sleep once converged.
+		//Draw the newest pose each of them finished, a slow solve never holds up the frame
+		for (int m = 0; m < meshCount; m++)
+			if (arapSolvers[m]->fetchPose())
+				parsedModel.meshes[m].UpdateMeshVertices();
 
 		//rendering
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); //activate better view of vertices of mesh
@@ -158,6 +178,7 @@ int main(int argc, char*argv[]) {
 		glfwPollEvents(); //processing callbacks 
 	}
 
+	arapSolvers.clear(); //stop the solver threads before the model goes away
 	glfwTerminate();
 	return 0;
 }
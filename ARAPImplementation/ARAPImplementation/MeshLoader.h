@@ -3,8 +3,11 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/config.h>
 #include <iostream>
 #include "OpenMeshType.h"
+#include <OpenMesh/Core/IO/MeshIO.hh>
+#include "MeshReordering.h"
 
 
 //load a model with assimp lib and translate it into multiple meshes
@@ -13,23 +16,30 @@ class Model
 public:
 	std::vector<Mesh> meshes;
 
-	Model(std::string const &path)
+	Model() {} //empty model, meshes are added by the owner
+
+	//reorder: rearrange vertices and triangles for cache locality, Mesh::originalIndex maps back to the file.
+	//A file with a single mesh is read with OpenMesh, one with several objects is split into one mesh per object by assimp
+	Model(std::string const &path, bool reorder = false)
 	{
+		reorderForLocality = reorder;
 		loadModel(path);
 	}
 
-	Model(TriMesh& mesh) {
+	//reorder: mesh is renumbered the same way, so a solver built from mesh and this model pairs the right vertices
+	Model(TriMesh& mesh, bool reorder = false) {
+		reorderForLocality = reorder;
 		processOpenMesh(mesh);
 	}
 
 	void Draw(unsigned int shader) {
-		for (Mesh curMesh : meshes)
+		for (Mesh& curMesh : meshes)
 		{
 			curMesh.Draw(shader);
 		}
 	}
 	void DrawModelViewProjection(unsigned int shader, glm::mat4 model, glm::mat4 view, glm::mat4 projection) {
-		for (Mesh curMesh : meshes)
+		for (Mesh& curMesh : meshes)
 		{
 			curMesh.DrawModelViewProjection(shader, model, view, projection);
 		}
@@ -38,6 +48,17 @@ public:
 private:
 	// model data
 	std::string directory; //dir to hold the model data
+	bool reorderForLocality = false; //reorder meshes at load
+
+	//create the Mesh, reordered before its buffers are set up
+	Mesh createMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<Texture>& textures) {
+		std::vector<unsigned int> originalIndex;
+		if (reorderForLocality)
+			meshReordering::reorder(vertices, indices, originalIndex);
+		Mesh mesh(vertices, indices, textures);
+		mesh.originalIndex = originalIndex;
+		return mesh;
+	}
 
 	//load mesh from OpenMesh data Type
 	void processOpenMesh(TriMesh& mesh) {
@@ -84,13 +105,25 @@ private:
 		}
 
 
-		meshes.push_back(Mesh(vertices, indices, textures));
+		meshes.push_back(createMesh(vertices, indices, textures));
+
+		if (reorderForLocality) { //createMesh reordered vertices and indices in place
+			TriMesh reordered;
+			for (const Vertex& vertex : meshes.back().vertices)
+				reordered.add_vertex(TriMesh::Point(vertex.Position.x, vertex.Position.y, vertex.Position.z));
+			for (size_t i = 0; i + 2 < indices.size(); i += 3)
+				reordered.add_face(OpenMesh::VertexHandle(indices[i]), OpenMesh::VertexHandle(indices[i + 1]), OpenMesh::VertexHandle(indices[i + 2]));
+			mesh = reordered;
+		}
 	}
 
 	void loadModel(std::string const &path) {
 		//loading
 		Assimp::Importer importer;
-		const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs); //post processing options: generate triangles if not present, flips text coords if neccesary
+		//the shaders only read positions and colors. Without normals and texture coordinates, joining identical vertices also welds the copies
+		//along uv seams and hard edges, so the mesh is one connected surface for ARAP instead of a triangle soup
+		importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, aiComponent_NORMALS | aiComponent_TEXCOORDS);
+		const aiScene *scene = importer.ReadFile(path, 0); //parse only, the post processing depends on the number of meshes
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) //check for scene and root node not null
 		{
@@ -99,6 +132,22 @@ private:
 		}
 		directory = path.substr(0, path.find_last_of('/'));
 
+		//a single mesh keeps the vertices of the file exactly as OpenMesh reads them
+		TriMesh mesh;
+		if (scene->mNumMeshes == 1 && OpenMesh::IO::read_mesh(mesh, path)) {
+			processOpenMesh(mesh);
+			std::cout << "Loaded Mesh: " << path << " From Dir: " << directory << std::endl;
+			return;
+		}
+
+		//post processing options: generate triangles if not present, flips text coords if neccesary, weld vertices
+		scene = importer.ApplyPostProcessing(aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_RemoveComponent | aiProcess_JoinIdenticalVertices);
+		if (!scene)
+		{
+			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+			return;
+		}
+
 		//convert scene into Meshes
 		processNode(scene->mRootNode, scene);
 
@@ -178,7 +227,7 @@ private:
 		
 		// TODO process material
 
-		return Mesh(vertices, indices, textures);
+		return createMesh(vertices, indices, textures);
 	}
 
 	//TODO
@@ -29,6 +29,7 @@ public:
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices; //for indices drawing with EBO
 	std::vector<Texture> textures; //TODO
+	std::vector<unsigned int> originalIndex; //index in the file of every vertex if it was reordered at load, empty if the file order was kept
 
 	//constructor
 	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
@@ -77,6 +78,19 @@ public:
 		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), &vertices[0], GL_STATIC_DRAW); //copy vertex data into buffer for opengl to use
 	}
 
+	//vertex index in the numbering of the file, for constraints and results exchanged with other tools
+	unsigned int fileIndex(unsigned int v) const {
+		return originalIndex.empty() ? v : originalIndex[v];
+	}
+
+	//vertex positions in the order of the file
+	std::vector<glm::vec3> filePositions() const {
+		std::vector<glm::vec3> positions(vertices.size());
+		for (unsigned int v = 0; v < vertices.size(); v++)
+			positions[fileIndex(v)] = vertices[v].Position;
+		return positions;
+	}
+
 private:
 	//data/ buffers for rendering with OpenGl
 	unsigned int VAO; //settings about reading vertex data from buffer and interpret it
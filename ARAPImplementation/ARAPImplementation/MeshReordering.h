@@ -0,0 +1,181 @@
+#pragma once
+#include "MeshRendering.h"
+#include <vector>
+#include <algorithm>
+
+//load-time reordering of a triangle mesh for locality. Files (scans in particular) often list vertices in near random order:
+//the solver then gathers its fans from all over memory and the GPU misses its post-transform cache
+namespace meshReordering {
+
+	//vertex adjacency in compressed form: the neighbors of v are neighbors[offsets[v] .. offsets[v + 1])
+	struct Adjacency {
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> neighbors;
+	};
+
+	inline Adjacency vertexAdjacency(const std::vector<unsigned int>& indices, size_t vertexCount) {
+		Adjacency adj;
+
+		//every corner adds its two triangle neighbors, shared edges are removed afterwards
+		std::vector<unsigned int> count(vertexCount + 1, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+			count[indices[i] + 1] += 2;
+		for (size_t v = 0; v < vertexCount; v++)
+			count[v + 1] += count[v];
+		std::vector<unsigned int> raw(count[vertexCount]);
+		std::vector<unsigned int> next(count.begin(), count.end() - 1);
+		for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				const unsigned int v = indices[t + k];
+				raw[next[v]++] = indices[t + (k + 1) % 3];
+				raw[next[v]++] = indices[t + (k + 2) % 3];
+			}
+		}
+
+		adj.offsets.assign(vertexCount + 1, 0);
+		adj.neighbors.reserve(raw.size() / 2);
+		for (size_t v = 0; v < vertexCount; v++) {
+			std::sort(raw.begin() + count[v], raw.begin() + count[v + 1]);
+			const auto end = std::unique(raw.begin() + count[v], raw.begin() + count[v + 1]);
+			adj.neighbors.insert(adj.neighbors.end(), raw.begin() + count[v], end);
+			adj.offsets[v + 1] = adj.neighbors.size();
+		}
+		return adj;
+	}
+
+	//reverse Cuthill-McKee: breadth first from a vertex of low valence in every connected component, neighbors by increasing valence.
+	//Neighbors end up close in memory and the bandwidth of the Laplacian small. Returns the old index of every new vertex
+	inline std::vector<unsigned int> reverseCuthillMcKee(const Adjacency& adj) {
+		const size_t vertexCount = adj.offsets.size() - 1;
+		auto valence = [&adj](unsigned int v) { return adj.offsets[v + 1] - adj.offsets[v]; };
+
+		//seeds in order of increasing valence
+		std::vector<unsigned int> seeds(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			seeds[v] = v;
+		std::stable_sort(seeds.begin(), seeds.end(), [&valence](unsigned int a, unsigned int b) { return valence(a) < valence(b); });
+
+		std::vector<unsigned int> order; //doubles as the queue of the breadth first search
+		order.reserve(vertexCount);
+		std::vector<char> visited(vertexCount, 0);
+		for (unsigned int seed : seeds) {
+			if (visited[seed])
+				continue;
+			visited[seed] = 1;
+			order.push_back(seed);
+			for (size_t head = order.size() - 1; head < order.size(); head++) {
+				const unsigned int v = order[head];
+				const size_t first = order.size();
+				for (unsigned int jj = adj.offsets[v]; jj < adj.offsets[v + 1]; jj++) {
+					const unsigned int u = adj.neighbors[jj];
+					if (!visited[u]) {
+						visited[u] = 1;
+						order.push_back(u);
+					}
+				}
+				std::stable_sort(order.begin() + first, order.end(), [&valence](unsigned int a, unsigned int b) { return valence(a) < valence(b); });
+			}
+		}
+		std::reverse(order.begin(), order.end());
+		return order;
+	}
+
+	//triangle order for the post-transform vertex cache (Tipsify, Sander et al. 2007): fan out around one vertex at a time, continue with
+	//the vertex of the last fans that is still in the cache and has the fewest triangles left, dead ends fall back to recent vertices.
+	//Keeps the winding of every triangle
+	inline void optimizeTriangleOrder(std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = 16) {
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		//triangles of every vertex
+		std::vector<unsigned int> offsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < 3 * triangleCount; i++)
+			offsets[indices[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			offsets[v + 1] += offsets[v];
+		std::vector<unsigned int> triangles(offsets[vertexCount]);
+		std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < 3 * triangleCount; i++)
+			triangles[next[indices[i]]++] = i / 3;
+
+		std::vector<int> live(vertexCount); //triangles of the vertex that are not emitted yet
+		for (size_t v = 0; v < vertexCount; v++)
+			live[v] = offsets[v + 1] - offsets[v];
+		std::vector<int> cacheTime(vertexCount, 0); //time the vertex entered the FIFO cache
+		std::vector<char> emitted(triangleCount, 0);
+		std::vector<unsigned int> deadEnd; //recently used vertices, the fallback if the candidates are all done
+		std::vector<unsigned int> candidates;
+		std::vector<unsigned int> ordered;
+		ordered.reserve(3 * triangleCount);
+
+		int time = cacheSize + 1;
+		size_t cursor = 0; //scan position for the last resort: any vertex with triangles left
+		long fan = 0;
+		while (fan >= 0) {
+			candidates.clear();
+			for (unsigned int jj = offsets[fan]; jj < offsets[fan + 1]; jj++) {
+				const unsigned int t = triangles[jj];
+				if (emitted[t])
+					continue;
+				emitted[t] = 1;
+				for (int k = 0; k < 3; k++) {
+					const unsigned int v = indices[3 * t + k];
+					ordered.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > cacheSize) { //miss: enters the cache
+						cacheTime[v] = time;
+						time++;
+					}
+				}
+			}
+
+			//next fan: the candidate that stays in the cache longest while its remaining triangles are emitted
+			fan = -1;
+			int best = -1;
+			for (unsigned int v : candidates) {
+				if (live[v] <= 0)
+					continue;
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+					priority = time - cacheTime[v];
+				if (priority > best) {
+					best = priority;
+					fan = v;
+				}
+			}
+			while (fan < 0 && !deadEnd.empty()) {
+				const unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					fan = v;
+			}
+			for (; fan < 0 && cursor < vertexCount; cursor++)
+				if (live[cursor] > 0)
+					fan = cursor;
+		}
+		indices.swap(ordered);
+	}
+
+	//reorder vertices (reverse Cuthill-McKee) and triangles (vertex cache) of a mesh. originalIndex receives the old index of every vertex,
+	//so selections and exports can be mapped back to the numbering of the file
+	inline void reorder(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<unsigned int>& originalIndex) {
+		const size_t vertexCount = vertices.size();
+		originalIndex = reverseCuthillMcKee(vertexAdjacency(indices, vertexCount));
+
+		std::vector<unsigned int> newIndex(vertexCount);
+		std::vector<Vertex> reordered(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++) {
+			newIndex[originalIndex[v]] = v;
+			reordered[v] = vertices[originalIndex[v]];
+		}
+		vertices.swap(reordered);
+		for (unsigned int& index : indices)
+			index = newIndex[index];
+
+		optimizeTriangleOrder(indices, vertexCount);
+	}
+
+}
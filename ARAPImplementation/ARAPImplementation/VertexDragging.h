@@ -1,6 +1,8 @@
 #pragma once
 #include "MeshLoader.h"
-#include "ARAPSolver.h"
+#include "AsyncARAPSolver.h"
+#include <algorithm>
+#include <limits>
 
 namespace vertexDragging {
 
@@ -15,8 +17,9 @@ namespace vertexDragging {
 
 	//data for our vertices
 	Model* ModelPointer; //get static Data in main.cpp
-	ARAP::ARAPSolver* ArapSolverPointer;
+	std::vector<ARAP::AsyncARAPSolver*> ArapSolverPointers; //one solver per mesh, indexed like ModelPointer->meshes
 	std::vector<int> selectedConstraints; //Movable
+	std::vector<int> selectedMeshes; //mesh of each selected constraint
 	std::vector<DragVertexData> selectedConstraintsData;
 
 	glm::vec3 dynamicConstraintColor(1.0f, 0.0f, 0.0f);
@@ -27,61 +30,90 @@ namespace vertexDragging {
 		ModelPointer = model;
 	}
 
-	void setARAP(ARAP::ARAPSolver* solver) {
-		ArapSolverPointer = solver;
+	void setARAP(const std::vector<ARAP::AsyncARAPSolver*>& solvers) {
+		ArapSolverPointers = solvers;
+	}
+
+	//index of selection i in the constraint list of the solver of its mesh: solvers only know the constraints of their own mesh
+	int solverConstraintIndex(int i) {
+		return std::count(selectedMeshes.begin(), selectedMeshes.begin() + i, selectedMeshes[i]);
 	}
 
 	//select vertices in the model that we want to drag
 	void pickVertex(GLFWwindow* window, double xMouse, double yMouse, glm::mat4 modelViewProjection) {
 
-		for (int i = 0; i < ModelPointer->meshes[0].vertices.size(); i++) {
-			glm::vec4 vertPos(ModelPointer->meshes[0].vertices[i].Position, 1);
-			glm::vec4 pos = modelViewProjection * vertPos; //ModelViewProjection: projection * view * model * vertPos
-			pos.x /= pos.w; //Perspective division to NDC
-			pos.y /= pos.w;
-			pos.z /= pos.w;
-
-			int width, height;
-			glfwGetWindowSize(window, &width, &height);
+		int width, height;
+		glfwGetWindowSize(window, &width, &height);
 
-			float X = (pos.x + 1.0f) * width * 0.5; //Get ViewPort coords
-			float Y = (1.0f - pos.y) * height * 0.5;
-			float Z = 0.1f + pos.z * (100.0f - 0.1f);
+		float radiusX = 5.0f;
+		float radiusY = 5.0f;
 
-			float radiusX = 5.0f;
-			float radiusY = 5.0f;
+		//the mesh with the vertex under the cursor closest to the camera was hit, meshes behind it are not picked through it
+		int hitMesh = -1;
+		float hitDepth = std::numeric_limits<float>::max();
+		std::vector<std::pair<int, DragVertexData>> hits; //vertices under the cursor of the hit mesh
 
-			if (abs(X - xMouse) < radiusX && abs(Y - yMouse) < radiusY) {//found click
-				auto searchPos = std::find(selectedConstraints.begin(), selectedConstraints.end(), i);
-				int index = std::distance(selectedConstraints.begin(), searchPos);
+		for (int m = 0; m < ModelPointer->meshes.size(); m++) {
+			const std::vector<Vertex>& vertices = ModelPointer->meshes[m].vertices;
+			for (int i = 0; i < vertices.size(); i++) {
+				glm::vec4 vertPos(vertices[i].Position, 1);
+				glm::vec4 pos = modelViewProjection * vertPos; //ModelViewProjection: projection * view * model * vertPos
+				pos.x /= pos.w; //Perspective division to NDC
+				pos.y /= pos.w;
+				pos.z /= pos.w;
 
-				if (searchPos != selectedConstraints.end()) { //constraint already selected -> put static
-					glm::vec3 curColor = ModelPointer->meshes[0].vertices[i].Color;
-					if (curColor == staticConstraintColor) { //clicked a prev static vertex
-						ModelPointer->meshes[0].vertices[i].Color = dynamicConstraintColor; //set dynamic and draggable
-					}
-					else { //clicked a dynamic vertex
-						ModelPointer->meshes[0].vertices[i].Color = origColor; //orig color
+				float X = (pos.x + 1.0f) * width * 0.5; //Get ViewPort coords
+				float Y = (1.0f - pos.y) * height * 0.5;
 
-						selectedConstraints.erase(searchPos);
-						selectedConstraintsData.erase(selectedConstraintsData.begin() + index);
-						ArapSolverPointer->untoggleConstraint(index);
+				if (abs(X - xMouse) < radiusX && abs(Y - yMouse) < radiusY) {//found click
+					if (m != hitMesh) {
+						if (pos.z >= hitDepth) //behind the mesh hit so far
+							continue;
+						hitMesh = m;
+						hitDepth = pos.z;
+						hits.clear();
 					}
-					
+					hitDepth = std::min(hitDepth, pos.z);
+					hits.push_back({ i, DragVertexData{ X, Y, pos.z } }); //TODO how to update x, y, z when rotating the screen?
 				}
-				else { //select
-					ModelPointer->meshes[0].vertices[i].Color = staticConstraintColor;
-					selectedConstraints.push_back(i);
-					selectedConstraintsData.push_back(DragVertexData{ X, Y, pos.z }); //TODO how to update x, y, z when rotating the screen?
-					ArapSolverPointer->toggleConstraint(i);
+			}
+		}
+		if (hitMesh < 0)
+			return;
+
+		Mesh& mesh = ModelPointer->meshes[hitMesh];
+		for (const std::pair<int, DragVertexData>& hit : hits) {
+			const int i = hit.first;
+			int index = 0;
+			while (index < selectedConstraints.size() && (selectedConstraints[index] != i || selectedMeshes[index] != hitMesh))
+				index++;
+
+			if (index < selectedConstraints.size()) { //constraint already selected -> put static
+				glm::vec3 curColor = mesh.vertices[i].Color;
+				if (curColor == staticConstraintColor) { //clicked a prev static vertex
+					mesh.vertices[i].Color = dynamicConstraintColor; //set dynamic and draggable
 				}
+				else { //clicked a dynamic vertex
+					mesh.vertices[i].Color = origColor; //orig color
 
-				ModelPointer->meshes[0].UpdateMeshVertices();
+					ArapSolverPointers[hitMesh]->untoggleConstraint(solverConstraintIndex(index));
+					selectedConstraints.erase(selectedConstraints.begin() + index);
+					selectedMeshes.erase(selectedMeshes.begin() + index);
+					selectedConstraintsData.erase(selectedConstraintsData.begin() + index);
+				}
 
 			}
-
+			else { //select
+				mesh.vertices[i].Color = staticConstraintColor;
+				selectedConstraints.push_back(i);
+				selectedMeshes.push_back(hitMesh);
+				selectedConstraintsData.push_back(hit.second);
+				ArapSolverPointers[hitMesh]->toggleConstraint(i);
+			}
 		}
 
+		mesh.UpdateMeshVertices();
+
 	}
 
 	//checks if view space has changed since last drag and if so recalculates screen Pos X Y and NDCZ
@@ -94,7 +126,7 @@ namespace vertexDragging {
 		{
 			for (int i = 0; i < selectedConstraints.size(); i++) {
 				int vertexIndex = selectedConstraints.at(i);
-				glm::vec4 vertPos(ModelPointer->meshes[0].vertices[vertexIndex].Position, 1);
+				glm::vec4 vertPos(ModelPointer->meshes[selectedMeshes.at(i)].vertices[vertexIndex].Position, 1);
 				glm::vec4 pos = modelViewProjection * vertPos; //ModelViewProjection: projection * view * model * vertPos
 				pos.x /= pos.w; //Perspective division to NDC
 				pos.y /= pos.w;
@@ -119,9 +151,10 @@ namespace vertexDragging {
 
 		for (int i = 0; i < selectedConstraints.size();i++) { //loop through all selected constraints and apply the offset to them
 			int vertexIndex = selectedConstraints.at(i);
+			Mesh& mesh = ModelPointer->meshes[selectedMeshes.at(i)];
 			DragVertexData vData = selectedConstraintsData.at(i);
 
-			if (ModelPointer->meshes[0].vertices[vertexIndex].Color == staticConstraintColor) //skip static constraints
+			if (mesh.vertices[vertexIndex].Color == staticConstraintColor) //skip static constraints
 				continue;
 
 			vData.X += xOffset; //apply mouse input
@@ -141,9 +174,9 @@ namespace vertexDragging {
 			reconstructedOrig /= reconstructedOrig.w;
 
 			//update the model
-			ModelPointer->meshes[0].vertices[vertexIndex].Position = glm::vec3(reconstructedOrig.x, reconstructedOrig.y, reconstructedOrig.z);
-			ArapSolverPointer->UpdateConstraint(vertexIndex, glm::vec3(reconstructedOrig.x, reconstructedOrig.y, reconstructedOrig.z));
-			ModelPointer->meshes[0].UpdateMeshVertices();
+			mesh.vertices[vertexIndex].Position = glm::vec3(reconstructedOrig.x, reconstructedOrig.y, reconstructedOrig.z);
+			ArapSolverPointers[selectedMeshes.at(i)]->UpdateConstraint(vertexIndex, glm::vec3(reconstructedOrig.x, reconstructedOrig.y, reconstructedOrig.z));
+			mesh.UpdateMeshVertices();
 
 		}
 
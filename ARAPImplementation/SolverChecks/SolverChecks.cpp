@@ -0,0 +1,509 @@
+#define _USE_MATH_DEFINES
+#include <glad\glad.h>
+#include <GLFW\glfw3.h>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <string>
+#include <functional>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include "ARAPSolver.h"
+#include "AsyncARAPSolver.h"
+
+//headless checks of the ARAP solver, run after changing it. Prints one line per check and exits with the number of failed checks.
+//The project defines EIGEN_RUNTIME_NO_MALLOC and keeps asserts on in every configuration: an Eigen allocation inside a counted
+//section asserts, everything else is counted by the operator new below
+
+static std::atomic<bool> countAllocations{ false };
+static std::atomic<long> allocations{ 0 };
+
+void* operator new(size_t size)
+{
+	if (countAllocations)
+		allocations++;
+	void* p = std::malloc(size > 0 ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+	std::cout << (ok ? "ok      " : "FAILED  ") << what << std::endl;
+	if (!ok)
+		failures++;
+}
+
+//size x size vertices on a gently curved sheet, two triangles per quad. A bend of 0 gives a flat one
+static TriMesh gridMesh(int size, float bend = 0.05f)
+{
+	TriMesh mesh;
+	for (int i = 0; i < size; i++)
+		for (int j = 0; j < size; j++)
+			mesh.add_vertex(TriMesh::Point(i * 0.1f, j * 0.1f, bend * std::sin(0.3f * i) * std::cos(0.2f * j)));
+	for (int i = 0; i + 1 < size; i++) {
+		for (int j = 0; j + 1 < size; j++) {
+			const int v = i * size + j;
+			mesh.add_face(OpenMesh::VertexHandle(v), OpenMesh::VertexHandle(v + size), OpenMesh::VertexHandle(v + size + 1));
+			mesh.add_face(OpenMesh::VertexHandle(v), OpenMesh::VertexHandle(v + size + 1), OpenMesh::VertexHandle(v + 1));
+		}
+	}
+	return mesh;
+}
+
+//ARAP energy of the current pose of the first mesh of model for the given constraints, whose targets are where they are in the pose
+static float poseEnergy(const Model& model, const TriMesh& restMesh, const std::vector<int>& constrained)
+{
+	Model probe;
+	probe.meshes.push_back(model.meshes[0]);
+	ARAP::ARAPSolver solver(&probe, restMesh);
+	for (int v : constrained) {
+		solver.toggleConstraint(v);
+		solver.UpdateConstraint(v, probe.meshes[0].vertices[v].Position);
+	}
+	return solver.ArapStep(1).energy; //the first local step evaluates the pose it starts from
+}
+
+//drag frames on a grid: the first row is pinned, the opposite corner is dragged. Returns the heap allocations of the frames after the warm-up
+static long dragAllocations(const std::function<void(ARAP::ARAPSolver&)>& configure)
+{
+	const int size = 30;
+	TriMesh mesh = gridMesh(size);
+	Model model(mesh);
+	ARAP::ARAPSolver solver(&model, mesh);
+	configure(solver);
+	for (int j = 0; j < size; j++)
+		solver.toggleConstraint(j);
+	const int handle = size * size - 1;
+	solver.toggleConstraint(handle);
+
+	const int warmUpFrames = 2; //the first frames size the workspace for the constraint set
+	const int frames = 10;
+	long counted = 0;
+	for (int f = 0; f < frames; f++) {
+		const glm::vec3 target = model.meshes[0].vertices[handle].Position + glm::vec3(0.02f, 0.01f, 0.03f);
+		solver.UpdateConstraint(handle, target);
+		const bool counting = f >= warmUpFrames;
+		allocations = 0;
+		countAllocations = counting;
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+		Eigen::internal::set_is_malloc_allowed(!counting);
+#endif
+		solver.ArapStep(5);
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+		Eigen::internal::set_is_malloc_allowed(true);
+#endif
+		countAllocations = false;
+		counted += allocations;
+	}
+	return counted;
+}
+
+//steady-state drag frames must not touch the heap, in every solver configuration
+static void checkSteadyStateAllocations()
+{
+	const std::pair<const char*, std::function<void(ARAP::ARAPSolver&)>> configurations[] = {
+		{ "default", [](ARAP::ARAPSolver&) {} },
+		{ "reduced system", [](ARAP::ARAPSolver& s) { s.setReducedSystem(true); } },
+		{ "conjugate gradient", [](ARAP::ARAPSolver& s) { s.setLinearSolver(ARAP::LinearSolver::ConjugateGradient); } },
+		{ "LDLT", [](ARAP::ARAPSolver& s) { s.setLinearSolver(ARAP::LinearSolver::SimplicialLDLT); } },
+		{ "Anderson acceleration", [](ARAP::ARAPSolver& s) { s.setAndersonAcceleration(5); } },
+		{ "temporal prediction and hierarchy", [](ARAP::ARAPSolver& s) { s.setTemporalPrediction(true); s.setHierarchyLevels(2); } },
+		{ "memory lean", [](ARAP::ARAPSolver& s) { s.setMemoryLean(true); } },
+		{ "region of interest", [](ARAP::ARAPSolver& s) { s.setRegionOfInterestRings(8); } },
+	};
+	for (const auto& configuration : configurations) {
+		const long counted = dragAllocations(configuration.second);
+		check(counted == 0, std::string("no allocations in steady-state drag frames (") + configuration.first + "): " + std::to_string(counted));
+	}
+}
+
+//constraint toggles refactorize numerically on the pattern analyzed for the first constraint set
+static void checkToggleReusesAnalysis()
+{
+	const int size = 30;
+	TriMesh mesh = gridMesh(size);
+	Model model(mesh);
+	ARAP::ARAPSolver solver(&model, mesh);
+	for (int j = 0; j < size; j++)
+		solver.toggleConstraint(j);
+	solver.ArapStep(1);
+
+	bool reused = true;
+	for (int k = 0; k < 5; k++) {
+		solver.toggleConstraint(size * size - 1 - 7 * k);
+		solver.ArapStep(1);
+		reused = reused && solver.factorizationStats().analyzeMs == 0;
+	}
+	solver.untoggleConstraint(size);
+	solver.ArapStep(1);
+	reused = reused && solver.factorizationStats().analyzeMs == 0;
+	check(reused, "constraint toggles reuse the symbolic analysis");
+}
+
+//energy of a solve from the rest pose straight to the final handle target, the yardstick for the drags
+static float optimumEnergy(TriMesh& mesh, const std::vector<int>& constrained, int handle, glm::vec3 target)
+{
+	Model reference(mesh);
+	ARAP::ARAPSolver solver(&reference, mesh);
+	for (int v : constrained)
+		solver.toggleConstraint(v);
+	solver.UpdateConstraint(handle, target);
+	reference.meshes[0].vertices[handle].Position = target; //the reference does not rely on the solver to place the handle
+	solver.ArapStep(1000, 1e-6f);
+	return poseEnergy(reference, mesh, constrained);
+}
+
+//a dragged handle pulls the mesh along: the solver must not stop early while the pose still lags behind the targets.
+//The drag ends at the energy of a solve from the rest pose straight to the final target
+static void checkDraggedHandleConverges()
+{
+	const int size = 40;
+	const int handle = size * size - 1;
+	std::vector<int> constrained;
+	for (int j = 0; j < size; j++)
+		constrained.push_back(j);
+	constrained.push_back(handle);
+	const int maxIterations = 100;
+	const float tolerance = 1e-3f;
+
+	TriMesh mesh = gridMesh(size);
+	Model model(mesh);
+	ARAP::ARAPSolver solver(&model, mesh);
+	for (int v : constrained)
+		solver.toggleConstraint(v);
+	const glm::vec3 start = model.meshes[0].vertices[handle].Position;
+	const glm::vec3 target = start + glm::vec3(0.5f, 0.3f, 1.2f);
+	const int frames = 20;
+	for (int f = 1; f <= frames; f++) {
+		solver.UpdateConstraint(handle, start + (target - start) * (float(f) / frames));
+		solver.ArapStep(maxIterations, tolerance);
+	}
+	for (int f = 0; f < 100 && !solver.ArapStep(maxIterations, tolerance).converged; f++);
+	const float dragged = poseEnergy(model, mesh, constrained);
+	const float optimum = optimumEnergy(mesh, constrained, handle, target);
+	check(dragged <= 1.03f * optimum, "dragged handle reaches its target energy: " + std::to_string(dragged) + " for an optimum of " + std::to_string(optimum));
+}
+
+//the same drag through the solver thread as in the app, without temporal prediction: the worker only sees the targets,
+//its copy of the mesh keeps the handle where the last pose left it
+static void checkAsyncDragConverges()
+{
+	const int size = 40;
+	const int handle = size * size - 1;
+	std::vector<int> constrained;
+	for (int j = 0; j < size; j++)
+		constrained.push_back(j);
+	constrained.push_back(handle);
+
+	TriMesh mesh = gridMesh(size);
+	Model model(mesh);
+	const glm::vec3 start = model.meshes[0].vertices[handle].Position;
+	const glm::vec3 target = start + glm::vec3(0.5f, 0.3f, 1.2f);
+	{
+		ARAP::AsyncARAPSolver async(&model, mesh);
+		async.start(100, 1e-3f, 10.0f);
+		for (int v : constrained)
+			async.toggleConstraint(v);
+		const int frames = 20;
+		for (int f = 1; f <= frames; f++) {
+			async.UpdateConstraint(handle, start + (target - start) * (float(f) / frames));
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			async.fetchPose();
+		}
+
+		//the worker sleeps once converged: wait until no new pose arrives for a while
+		const auto begin = std::chrono::steady_clock::now();
+		auto lastPose = begin;
+		while (std::chrono::steady_clock::now() - begin < std::chrono::seconds(20)) {
+			if (async.fetchPose())
+				lastPose = std::chrono::steady_clock::now();
+			else if (std::chrono::steady_clock::now() - lastPose > std::chrono::milliseconds(500))
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	const float dragged = poseEnergy(model, mesh, constrained);
+	const float optimum = optimumEnergy(mesh, constrained, handle, target);
+	check(dragged <= 1.03f * optimum, "dragged handle on the solver thread reaches its target energy: " + std::to_string(dragged) + " for an optimum of " + std::to_string(optimum));
+}
+
+//a rigid motion costs no ARAP energy. The rotations of the local step start at the identity, and on a flat sheet a half turn
+//about its normal makes the identity a stationary point of the rotation extraction: it has to be told apart from the maximum
+static void checkRigidRotationsHaveNoEnergy()
+{
+	const int size = 20;
+	for (float degrees : { 90.f, 180.f }) {
+		TriMesh mesh = gridMesh(size, 0);
+		Model model(mesh);
+		ARAP::ARAPSolver solver(&model, mesh);
+		const float c = std::cos(float(degrees * M_PI / 180)), s = std::sin(float(degrees * M_PI / 180));
+		std::vector<Vertex>& vertices = model.meshes[0].vertices;
+		for (int v = 0; v < vertices.size(); v++) {
+			const glm::vec3 p = vertices[v].Position;
+			solver.toggleConstraint(v);
+			solver.UpdateConstraint(v, glm::vec3(c * p.x - s * p.y, s * p.x + c * p.y, p.z));
+		}
+		const float energy = solver.ArapStep(2).energy;
+		check(energy < 1e-5f, "mesh rotated rigidly by " + std::to_string(int(degrees)) + " degrees has no ARAP energy: " + std::to_string(energy));
+	}
+}
+
+//ARAP energy of pose with the optimal rotation of every fan from the SVD, the reference for the rotation extraction of the solver.
+//Cotangent weights as in the solver: the mean cotangent of the angles opposite of the edge (the one angle on the boundary), clamped to 0
+static float procrustesEnergy(const TriMesh& restMesh, const std::vector<glm::vec3>& pose)
+{
+	auto toVector = [](const TriMesh::Point& p) { return Eigen::Vector3f(p[0], p[1], p[2]); };
+	auto cotangent = [&](const TriMesh::Point& v, const TriMesh::Point& u, const TriMesh::Point& other) {
+		const Eigen::Vector3f a = toVector(u) - toVector(other), b = toVector(v) - toVector(other);
+		const float sine = a.cross(b).norm();
+		return sine > 0 ? a.dot(b) / sine : 0.f;
+	};
+
+	double energy = 0;
+	for (int v = 0; v < restMesh.n_vertices(); v++) {
+		const TriMesh::VertexHandle vh(v);
+		Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+		float fanEnergy = 0;
+		for (TriMesh::VertexOHalfedgeIter voh_it = restMesh.cvoh_iter(vh); voh_it.is_valid(); ++voh_it) {
+			const TriMesh::VertexHandle u = voh_it->to();
+			const TriMesh::HalfedgeHandle opposite = restMesh.opposite_halfedge_handle(*voh_it);
+			float weight = 0;
+			if (!restMesh.is_boundary(*voh_it))
+				weight += cotangent(restMesh.point(vh), restMesh.point(u), restMesh.point(restMesh.to_vertex_handle(restMesh.next_halfedge_handle(*voh_it))));
+			if (!restMesh.is_boundary(opposite))
+				weight += cotangent(restMesh.point(vh), restMesh.point(u), restMesh.point(restMesh.from_vertex_handle(restMesh.prev_halfedge_handle(opposite))));
+			if (!restMesh.is_boundary(*voh_it) && !restMesh.is_boundary(opposite))
+				weight /= 2;
+			weight = std::max(weight, 0.f);
+
+			const Eigen::Vector3f rest = toVector(restMesh.point(u)) - toVector(restMesh.point(vh));
+			const Eigen::Vector3f deformed(pose[u.idx()].x - pose[v].x, pose[u.idx()].y - pose[v].y, pose[u.idx()].z - pose[v].z);
+			covariance += weight * rest * deformed.transpose();
+			fanEnergy += weight * (rest.squaredNorm() + deformed.squaredNorm());
+		}
+		//the largest tr(R^T * covariance^T) over the rotations R is the sum of the singular values, the smallest one negated for a reflection
+		Eigen::JacobiSVD<Eigen::Matrix3f> svd(covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+		const Eigen::Vector3f sigma = svd.singularValues();
+		const float sign = (svd.matrixU() * svd.matrixV().transpose()).determinant() < 0 ? -1.f : 1.f;
+		energy += fanEnergy - 2 * (sigma(0) + sigma(1) + sign * sigma(2));
+	}
+	return energy;
+}
+
+//the batched rotation extraction of the local step finds the same rotations as the SVD. A twisted, noisy sheet turns its fans
+//up to one and a half times around, away from the identity the extraction starts at. Without the SVD fallback for lanes that
+//stop early or at a saddle the energy comes out about 0.08% too high
+static void checkRotationsMatchProcrustes()
+{
+	const int size = 20;
+	TriMesh mesh = gridMesh(size);
+	Model model(mesh);
+	ARAP::ARAPSolver solver(&model, mesh);
+
+	std::srand(1);
+	std::vector<glm::vec3> pose(model.meshes[0].vertices.size());
+	for (int v = 0; v < pose.size(); v++) {
+		const glm::vec3 p = model.meshes[0].vertices[v].Position;
+		const float angle = float(3 * M_PI * p.y / (0.1f * (size - 1))); //twist about the x axis along y
+		auto noise = []() { return 0.02f * (float(std::rand()) / RAND_MAX - 0.5f); };
+		pose[v] = glm::vec3(p.x + noise(), std::cos(angle) * p.y - std::sin(angle) * p.z + noise(), std::sin(angle) * p.y + std::cos(angle) * p.z + noise());
+		solver.toggleConstraint(v);
+		solver.UpdateConstraint(v, pose[v]);
+	}
+	const float extracted = solver.ArapStep(1).energy; //the first local step evaluates the pose it starts from
+	const float reference = procrustesEnergy(mesh, pose);
+	check(std::abs(extracted - reference) <= 1e-5f * reference, "rotation extraction matches the SVD: energy " + std::to_string(extracted) + " for " + std::to_string(reference));
+}
+
+//every fill ordering factors the same system: the iterations from the same start give the same poses up to rounding
+static void checkFillOrderingsAgree()
+{
+	const int size = 30;
+	const int handle = size * size - 1;
+	TriMesh mesh = gridMesh(size);
+	const glm::vec3 offset(0.4f, 0.2f, 0.8f);
+
+	std::vector<glm::vec3> reference;
+	float difference = 0;
+	for (ARAP::FillOrdering ordering : { ARAP::FillOrdering::AMD, ARAP::FillOrdering::COLAMD, ARAP::FillOrdering::NestedDissection, ARAP::FillOrdering::Natural, ARAP::FillOrdering::Automatic }) {
+		Model model(mesh);
+		ARAP::ARAPSolver solver(&model, mesh, 0, ordering);
+		for (int j = 0; j < size; j++)
+			solver.toggleConstraint(j);
+		solver.toggleConstraint(handle);
+		solver.UpdateConstraint(handle, model.meshes[0].vertices[handle].Position + offset);
+		solver.ArapStep(10);
+
+		const std::vector<Vertex>& vertices = model.meshes[0].vertices;
+		if (reference.empty()) {
+			for (const Vertex& vertex : vertices)
+				reference.push_back(vertex.Position);
+			continue;
+		}
+		for (int v = 0; v < vertices.size(); v++)
+			difference = std::max(difference, glm::length(vertices[v].Position - reference[v]));
+	}
+	check(difference < 1e-3f * glm::length(offset), "all fill orderings give the same poses: " + std::to_string(difference) + " apart");
+}
+
+//a model reordered at load deforms like the file order: constraints given in the numbering of the file are mapped into the mesh,
+//the solved positions are read back in the order of the file
+static void checkReorderedMeshMatchesFileOrder()
+{
+	const int size = 30;
+	const int handle = size * size - 1;
+	std::vector<int> constrained;
+	for (int j = 0; j < size; j++)
+		constrained.push_back(j);
+	constrained.push_back(handle);
+
+	TriMesh fileMesh = gridMesh(size);
+	Model fileModel(fileMesh);
+	TriMesh reorderedMesh = gridMesh(size);
+	Model reorderedModel(reorderedMesh, true);
+	const Mesh& reordered = reorderedModel.meshes[0];
+	std::vector<int> meshIndex(reordered.vertices.size());
+	for (int v = 0; v < reordered.vertices.size(); v++)
+		meshIndex[reordered.fileIndex(v)] = v;
+
+	float roundTrip = 0;
+	const std::vector<glm::vec3> restPositions = reordered.filePositions();
+	for (int v = 0; v < restPositions.size(); v++)
+		roundTrip = std::max(roundTrip, glm::length(restPositions[v] - fileModel.meshes[0].vertices[v].Position));
+	check(!reordered.originalIndex.empty() && roundTrip == 0, "reordered vertices map back to the file order");
+
+	ARAP::ARAPSolver fileSolver(&fileModel, fileMesh);
+	ARAP::ARAPSolver reorderedSolver(&reorderedModel, reorderedMesh);
+	for (int v : constrained) {
+		fileSolver.toggleConstraint(v);
+		reorderedSolver.toggleConstraint(meshIndex[v]);
+	}
+	const glm::vec3 offset(0.4f, 0.2f, 0.8f);
+	const glm::vec3 target = fileModel.meshes[0].vertices[handle].Position + offset;
+	fileSolver.UpdateConstraint(handle, target);
+	reorderedSolver.UpdateConstraint(meshIndex[handle], target);
+	const float fileEnergy = fileSolver.ArapStep(1000, 1e-7f).energy;
+	const float reorderedEnergy = reorderedSolver.ArapStep(1000, 1e-7f).energy;
+
+	float difference = 0;
+	const std::vector<glm::vec3> solvedPositions = reordered.filePositions();
+	for (int v = 0; v < solvedPositions.size(); v++)
+		difference = std::max(difference, glm::length(solvedPositions[v] - fileModel.meshes[0].vertices[v].Position));
+	//the energy is flat around the optimum, single precision solves stop at slightly different poses. Pairing the wrong
+	//vertices would move whole rows of the grid by about the handle offset
+	check(std::abs(fileEnergy - reorderedEnergy) < 1e-3f * fileEnergy && difference < 0.02f * glm::length(offset),
+		"reordered model deforms like the file order: energy " + std::to_string(reorderedEnergy) + " for " + std::to_string(fileEnergy) + ", poses " + std::to_string(difference) + " apart");
+}
+
+//a file with two objects that meet at a seam, every face corner with its own texture coordinate and every face with its own normal,
+//as exporters write uv seams and hard edges. The loader has to weld each object back into one surface, or ARAP sees a triangle soup
+static void checkMultiMeshFileWithSeams()
+{
+	const int size = 8;
+	const char* path = "arap_seam_check.obj";
+	{
+		std::ofstream file(path);
+		for (int object = 0; object < 2; object++) //the first column of the second object repeats the last one of the first
+			for (int i = 0; i < size; i++)
+				for (int j = 0; j < size; j++)
+					file << "v " << (object * (size - 1) + i) * 0.1f << " " << j * 0.1f << " 0\n";
+		int corner = 1;
+		int face = 1;
+		for (int object = 0; object < 2; object++) {
+			file << "o part" << object << "\n";
+			for (int i = 0; i + 1 < size; i++) {
+				for (int j = 0; j + 1 < size; j++) {
+					const int v = object * size * size + i * size + j + 1;
+					const int triangles[2][3] = { { v, v + size, v + size + 1 }, { v, v + size + 1, v + 1 } };
+					for (const auto& triangle : triangles) {
+						file << "vt " << i << " " << j << "\nvt " << i << " " << j << "\nvt " << i << " " << j << "\nvn 0 0 1\n";
+						file << "f";
+						for (int k = 0; k < 3; k++)
+							file << " " << triangle[k] << "/" << corner++ << "/" << face;
+						file << "\n";
+						face++;
+					}
+				}
+			}
+		}
+	}
+	Model model(path);
+	std::remove(path);
+
+	check(model.meshes.size() == 2, "a file with two objects loads as two meshes: " + std::to_string(model.meshes.size()));
+	for (size_t m = 0; m < model.meshes.size(); m++) {
+		std::vector<Vertex>& vertices = model.meshes[m].vertices;
+		check(vertices.size() == size * size, "mesh " + std::to_string(m) + " is welded along its seams: " + std::to_string(vertices.size()) + " vertices for " + std::to_string(size * size) + " positions");
+
+		//pin the left column, pull the top right corner: the whole object follows, a soup would only move the handle's triangle
+		ARAP::ARAPSolver solver(&model, int(m));
+		const float left = (m * (size - 1)) * 0.1f;
+		int handle = 0;
+		int center = 0;
+		const glm::vec2 middle(left + (size - 1) * 0.05f, (size - 1) * 0.05f);
+		for (int v = 0; v < vertices.size(); v++) {
+			const glm::vec3 p = vertices[v].Position;
+			if (p.x < left + 0.05f)
+				solver.toggleConstraint(v);
+			if (p.x + p.y > vertices[handle].Position.x + vertices[handle].Position.y)
+				handle = v;
+			if (glm::length(glm::vec2(p.x, p.y) - middle) < glm::length(glm::vec2(vertices[center].Position.x, vertices[center].Position.y) - middle))
+				center = v;
+		}
+		solver.toggleConstraint(handle);
+		const glm::vec3 rest = vertices[center].Position;
+		solver.UpdateConstraint(handle, vertices[handle].Position + glm::vec3(0, 0, 0.5f));
+		solver.ArapStep(50, 1e-4f);
+		check(glm::length(vertices[center].Position - rest) > 0.01f, "dragging a corner of mesh " + std::to_string(m) + " moves its center");
+	}
+}
+
+int main()
+{
+	//the meshes of a Model set up their GL buffers, so the checks need a context. The window is never shown
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "ARAP checks", NULL, NULL);
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return -1;
+	}
+
+	checkSteadyStateAllocations();
+	checkToggleReusesAnalysis();
+	checkDraggedHandleConverges();
+	checkAsyncDragConverges();
+	checkRigidRotationsHaveNoEnergy();
+	checkRotationsMatchProcrustes();
+	checkFillOrderingsAgree();
+	checkReorderedMeshMatchesFileOrder();
+	checkMultiMeshFileWithSeams();
+
+	std::cout << (failures == 0 ? "all checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+	glfwTerminate();
+	return failures;
+}